@@ -1,13 +1,82 @@
 #include <CLI/App.hpp>
 #include <CLI/Config.hpp>
 #include <CLI/Formatter.hpp>
+#include <algorithm>
 #include <chrono>
 #include <fmt/core.h>
 #include <fstream>
 #include <mni.hpp>
+#include <numeric>
 #include <ostream>
 #include <thread>
 
+// Breakdown of the optimized bits by item type, section and largest function bodies
+static void PrintBitStats(const Mni::Wasm::BitStats& bit_stats) {
+	auto percent = [&](uint64_t bits) {
+		return 100.0 * bits / std::max<uint64_t>(bit_stats.total_bits, 1);
+	};
+
+	fmt::print("Bits by item type:\n");
+	fmt::print("    {:<14} {:>8} {:>6.1f}%\n", "header", bit_stats.header_bits,
+		percent(bit_stats.header_bits));
+	for(size_t type = 0; type < bit_stats.type_bits.size(); type++) {
+		if(bit_stats.type_items[type] != 0) {
+			fmt::print("    {:<14} {:>8} {:>6.1f}% ({} items)\n",
+				Mni::Wasm::ItemTypeName((Mni::Wasm::WasmItemType)type), bit_stats.type_bits[type],
+				percent(bit_stats.type_bits[type]), bit_stats.type_items[type]);
+		}
+	}
+	fmt::print("Bits by section:\n");
+	for(uint8_t id = 0; id < bit_stats.section_bits.size(); id++) {
+		if(bit_stats.section_bits[id] != 0) {
+			fmt::print("    {:<14} {:>8} {:>6.1f}%\n", Mni::Wasm::SectionName(id),
+				bit_stats.section_bits[id], percent(bit_stats.section_bits[id]));
+		}
+	}
+	// Largest bodies first
+	std::vector<uint32_t> functions(bit_stats.function_bits.size());
+	std::iota(functions.begin(), functions.end(), 0);
+	std::stable_sort(functions.begin(), functions.end(), [&](uint32_t a, uint32_t b) {
+		return bit_stats.function_bits[a] > bit_stats.function_bits[b];
+	});
+	fmt::print("Bits by function body:\n");
+	for(size_t i = 0; i < functions.size() && i < 10; i++) {
+		fmt::print("    body {:<9} {:>8} {:>6.1f}%\n", functions[i],
+			bit_stats.function_bits[functions[i]], percent(bit_stats.function_bits[functions[i]]));
+	}
+}
+
+// Same breakdown as JSON, with every function body in index order
+static std::string BitStatsJson(const Mni::Wasm::BitStats& bit_stats) {
+	std::string json = fmt::format(
+		"{{\"total_bits\":{},\"header_bits\":{},", bit_stats.total_bits, bit_stats.header_bits);
+	json += "\"types\":{";
+	bool first = true;
+	for(size_t type = 0; type < bit_stats.type_bits.size(); type++) {
+		if(bit_stats.type_items[type] != 0) {
+			json += fmt::format("{}\"{}\":{{\"bits\":{},\"items\":{}}}", first ? "" : ",",
+				Mni::Wasm::ItemTypeName((Mni::Wasm::WasmItemType)type), bit_stats.type_bits[type],
+				bit_stats.type_items[type]);
+			first = false;
+		}
+	}
+	json += "},\"sections\":{";
+	first = true;
+	for(uint8_t id = 0; id < bit_stats.section_bits.size(); id++) {
+		if(bit_stats.section_bits[id] != 0) {
+			json += fmt::format("{}\"{}\":{}", first ? "" : ",", Mni::Wasm::SectionName(id),
+				bit_stats.section_bits[id]);
+			first = false;
+		}
+	}
+	json += "},\"functions\":[";
+	for(size_t i = 0; i < bit_stats.function_bits.size(); i++) {
+		json += fmt::format("{}{}", i == 0 ? "" : ",", bit_stats.function_bits[i]);
+	}
+	json += "]}\n";
+	return json;
+}
+
 int main(int argc, char** argv) {
 	CLI::App app { "A compiler and runtime for small Webassembly on QR codes" };
 	app.require_subcommand(1, 1);
@@ -18,6 +87,43 @@ int main(int argc, char** argv) {
 		"-o,--output", optimized_output_path, "Compressed webassembly output (.owasm)");
 	std::string qr_path;
 	compile_sub.add_option("-q,--qr", qr_path, "QR code containing compressed webassembly (.png)");
+	bool columns = false;
+	compile_sub.add_flag(
+		"--columns", columns, "Split compressed webassembly into columns by item type");
+	bool function_index = false;
+	compile_sub.add_flag("--function-index", function_index,
+		"Include function body offsets so bodies can be decoded in parallel");
+	bool metadata = false;
+	compile_sub.add_flag(
+		"--metadata", metadata, "Include metadata readable without decoding the webassembly");
+	bool parallel = false;
+	compile_sub.add_flag(
+		"--parallel", parallel, "Encode function bodies on multiple threads, output is identical");
+	bool stats = false;
+	compile_sub.add_flag(
+		"--stats", stats, "Print the bits used by every item type, section and function");
+	std::string stats_path;
+	compile_sub.add_option("--stats-json", stats_path, "Write the same bit breakdown as JSON");
+	uint32_t max_rounds = 0;
+	compile_sub.add_option("--rounds", max_rounds,
+		"Rounds of optimization passes at most, 0 runs until the module stops shrinking");
+	uint32_t time_budget = 0;
+	compile_sub.add_option("--time-budget", time_budget,
+		"Milliseconds to spend on optimization passes, 0 is unlimited");
+	bool search = false;
+	compile_sub.add_flag("--search", search,
+		"Try several optimization pipelines and keep the one with the fewest bits");
+	uint32_t target_version = 0;
+	compile_sub.add_option("--target-version", target_version,
+		"Stop searching once the QR code fits this version (1-40)");
+	bool no_cache = false;
+	compile_sub.add_flag("--no-cache", no_cache, "Always compile, do not read or write the cache");
+	std::string cache_dir;
+	compile_sub.add_option("--cache-dir", cache_dir,
+		"Directory of cached compile results, MNI_CACHE_DIR or the user cache by default");
+	uint64_t cache_size = 512;
+	compile_sub.add_option(
+		"--cache-size", cache_size, "Megabytes kept in the cache, least recently used go first");
 	std::string wasm_input;
 	compile_sub.add_option("wasm", wasm_input, "Webassembly module to compress")->required();
 
@@ -38,6 +144,16 @@ int main(int argc, char** argv) {
 	run_wasm.add_option("-q,--qr", qr_path_run, "QR code containing compressed webassembly (.png)");
 	run_wasm.require_option(1);
 
+	auto& dump_sub  = *app.add_subcommand("dump", "List every item of Webassembly with its bits");
+	auto& dump_wasm = *dump_sub.add_option_group("wasm");
+	std::string wasm_input_dump;
+	dump_wasm.add_option(
+		"-w,--wasm", wasm_input_dump, "Optimized or normal webassembly to list (.owasm, .wasm)");
+	std::string qr_path_dump;
+	dump_wasm.add_option(
+		"-q,--qr", qr_path_dump, "QR code containing compressed webassembly (.png)");
+	dump_wasm.require_option(1);
+
 	CLI11_PARSE(app, argc, argv);
 
 	std::chrono::time_point<std::chrono::steady_clock> start;
@@ -53,31 +169,109 @@ int main(int argc, char** argv) {
 		time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
 		fmt::print("Input wasm: {} bytes ({}ms)\n", wasm_bytes.size(), time_taken);
 
+		// Replaced by the exports of the purged module, only checks they are readable
 		std::vector<std::string> exported_functions;
-		Mni::Wasm::GetExports(wasm_bytes, exported_functions);
-		for(auto& name : exported_functions) {
-			fmt::print("    {}\n", name);
+		if(!Mni::Wasm::GetExports(wasm_bytes, exported_functions)) {
+			std::cerr << "Could not read the exports of the webassembly" << std::endl;
+			exit(1);
+		}
+
+		// Unchanged inputs compiled with the same options come back from the cache
+		// Parallel encoding is left out of the key, its output is identical
+		std::filesystem::path cache_path
+			= cache_dir.empty() ? Mni::Cache::DefaultDirectory() : std::filesystem::path(cache_dir);
+		std::string cache_key;
+		Mni::Cache::Entry cached;
+		bool cache_hit = false;
+		if(!no_cache) {
+			cache_key = Mni::Cache::Key(wasm_bytes,
+				fmt::format("columns={} function_index={} metadata={} rounds={} time_budget={} "
+							"search={} target_version={}",
+					columns, function_index, metadata, max_rounds, time_budget, search,
+					target_version));
+			cache_hit = Mni::Cache::Load(cache_path, cache_key, cached);
 		}
 
 		std::vector<uint8_t> out;
-		start = std::chrono::high_resolution_clock::now();
-		Mni::Wasm::RemoveUnneccesary(wasm_bytes, out, Mni::Wasm::DEFINED_FUNCTIONS);
-		stop       = std::chrono::high_resolution_clock::now();
-		time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
-		fmt::print("Purged wasm: {} bytes ({}ms)\n", out.size(), time_taken);
+		if(cache_hit) {
+			out                = std::move(cached.wasm);
+			exported_functions = std::move(cached.exports);
+			fmt::print("Purged wasm: {} bytes (cached)\n", out.size());
+		} else {
+			std::vector<Mni::Wasm::ShrinkRound> rounds;
+			std::vector<Mni::Wasm::SearchResult> searched;
+			// Candidates of the search are scored with the same encoding as the output
+			Mni::Wasm::OptimizedOptions encoding
+				= { .columns = columns, .function_index = function_index, .metadata = metadata };
+			start = std::chrono::high_resolution_clock::now();
+			Mni::Wasm::RemoveUnneccesary(wasm_bytes, out, Mni::Wasm::DEFINED_FUNCTIONS.names,
+				&exported_functions,
+				{ .max_rounds     = max_rounds,
+					.time_budget    = std::chrono::milliseconds(time_budget),
+					.rounds         = &rounds,
+					.search         = search,
+					.target_version = (uint8_t)target_version,
+					.encoding       = encoding,
+					.searched       = &searched });
+			stop = std::chrono::high_resolution_clock::now();
+			time_taken
+				= std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+			fmt::print("Purged wasm: {} bytes ({}ms)\n", out.size(), time_taken);
+			for(auto& result : searched) {
+				if(result.bits == UINT64_MAX) {
+					fmt::print("    pipeline {}: skipped\n", result.pipeline);
+				} else {
+					fmt::print("    pipeline {}: {} bits\n", result.pipeline, result.bits);
+				}
+			}
+			for(size_t i = 0; i < rounds.size(); i++) {
+				fmt::print("    round {}: {} functions, estimate {} ({}ms)\n", i + 1,
+					rounds[i].functions, rounds[i].estimate,
+					std::chrono::duration_cast<std::chrono::milliseconds>(rounds[i].time)
+						.count());
+			}
+		}
 
-		Mni::Wasm::GetExports(out, exported_functions);
 		for(auto& name : exported_functions) {
 			fmt::print("    {}\n", name);
 		}
 
+		// Items of the optimized stream, for the bit breakdown
+		std::vector<Mni::Wasm::TracedItem> trace;
+		bool traced = stats || !stats_path.empty();
+
 		std::vector<uint8_t> out_optimized;
-		start      = std::chrono::high_resolution_clock::now();
-		auto size  = Mni::Wasm::NormalToOptimized(out, 0, out_optimized);
-		stop       = std::chrono::high_resolution_clock::now();
-		time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
-		fmt::print(
-			"Optimized wasm: {} bytes / {} bits ({}ms)\n", out_optimized.size(), size, time_taken);
+		uint64_t size = 0;
+		// A trace has to be recorded by encoding again, which gives the same stream
+		if(cache_hit && !traced) {
+			out_optimized = std::move(cached.optimized);
+			size          = cached.size;
+			fmt::print("Optimized wasm: {} bytes / {} bits (cached)\n", out_optimized.size(), size);
+		} else {
+			start = std::chrono::high_resolution_clock::now();
+			size  = Mni::Wasm::NormalToOptimized(out, 0, out_optimized,
+				{ .columns        = columns,
+					.function_index = function_index,
+					.parallel       = parallel,
+					.metadata       = metadata,
+					.trace          = traced ? &trace : nullptr });
+			stop = std::chrono::high_resolution_clock::now();
+			time_taken
+				= std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+			fmt::print("Optimized wasm: {} bytes / {} bits ({}ms)\n", out_optimized.size(), size,
+				time_taken);
+		}
+
+		if(traced) {
+			auto bit_stats = Mni::Wasm::CountBits(trace, size);
+			if(stats) {
+				PrintBitStats(bit_stats);
+			}
+			if(!stats_path.empty()) {
+				std::ofstream stats_out(stats_path);
+				stats_out << BitStatsJson(bit_stats);
+			}
+		}
 
 		if(!optimized_output_path.empty()) {
 			// Extension is generally .owasm (optimized wasm)
@@ -94,7 +288,15 @@ int main(int argc, char** argv) {
 		if(!qr_path.empty()) {
 			start = std::chrono::high_resolution_clock::now();
 
-			if(!Mni::Export::GenerateQRCode(size, out_optimized, 1000, 1000, qr_path)) {
+			if(!cached.qr_png.empty()) {
+				std::ofstream qr_out(qr_path, std::ios::out | std::ios::binary);
+				qr_out.write((const char*)cached.qr_png.data(), cached.qr_png.size());
+				qr_out.close();
+				if(qr_out.fail()) {
+					std::cerr << "Could not write the QR code to " << qr_path << std::endl;
+					exit(1);
+				}
+			} else if(!Mni::Export::GenerateQRCode(size, out_optimized, 1000, 1000, qr_path)) {
 				std::cerr << out_optimized.size()
 						  << " bytes is too large for a QR code, 2953 bytes is the max"
 						  << std::endl;
@@ -106,11 +308,30 @@ int main(int argc, char** argv) {
 				= std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
 			fmt::print("QR code written ({}ms)\n", time_taken);
 		}
+
+		// New results, or a cached one that gained its QR code
+		if(!no_cache && (!cache_hit || (!qr_path.empty() && cached.qr_png.empty()))) {
+			Mni::Cache::Entry entry { .wasm = std::move(out),
+				.exports   = std::move(exported_functions),
+				.optimized = std::move(out_optimized),
+				.size      = size };
+			if(!qr_path.empty()) {
+				std::ifstream qr_file(qr_path, std::ios::binary);
+				entry.qr_png.assign(
+					std::istreambuf_iterator<char>(qr_file), std::istreambuf_iterator<char>());
+			}
+			if(!Mni::Cache::Store(cache_path, cache_key, entry, cache_size << 20)) {
+				std::cerr << "Could not write to the cache in " << cache_path << std::endl;
+			}
+		}
 	} else if(meta_sub) {
 		std::vector<uint8_t> optimized_wasm_bytes;
 		if(!qr_path_meta.empty()) {
 			start = std::chrono::high_resolution_clock::now();
-			Mni::Import::ScanQRCode(optimized_wasm_bytes, qr_path_meta);
+			if(!Mni::Import::ScanQRCode(optimized_wasm_bytes, qr_path_meta)) {
+				std::cerr << "QR code could not be read or is corrupt" << std::endl;
+				exit(1);
+			}
 			stop = std::chrono::high_resolution_clock::now();
 			time_taken
 				= std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
@@ -129,23 +350,40 @@ int main(int argc, char** argv) {
 		}
 
 		start = std::chrono::high_resolution_clock::now();
-		std::vector<uint8_t> wasm_bytes;
-		auto size  = Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, optimized_wasm_bytes);
-		stop       = std::chrono::high_resolution_clock::now();
-		time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
-		fmt::print("Input wasm: {} bytes ({}ms)\n", wasm_bytes.size(), time_taken);
+		Mni::Wasm::Metadata metadata;
+		if(!Mni::Wasm::ReadMetadata(optimized_wasm_bytes, 0, metadata)) {
+			// No metadata block, decode and ask the module itself
+			std::vector<uint8_t> wasm_bytes;
+			Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, optimized_wasm_bytes);
+			fmt::print("Input wasm: {} bytes\n", wasm_bytes.size());
 
-		start         = std::chrono::high_resolution_clock::now();
-		auto metadata = Mni::Wasm::Runtime(wasm_bytes).Meta();
-		stop          = std::chrono::high_resolution_clock::now();
-		time_taken    = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
-		fmt::print("Output: ({}ms)\n", time_taken);
-		std::cout << "    name: " << metadata.name << std::endl;
+			Mni::Wasm::Runtime runtime(wasm_bytes);
+			if(!runtime.PrepareWasm()) {
+				return -1;
+			}
+			metadata = runtime.Meta();
+			Mni::Wasm::ScanExports(wasm_bytes, metadata.exports, &metadata.imports);
+		}
+		stop       = std::chrono::high_resolution_clock::now();
+		time_taken = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+		fmt::print("Output: ({}us)\n", time_taken);
+		fmt::print("    name: {}\n", metadata.name);
+		fmt::print("    bounds: {}x{}\n", metadata.width, metadata.height);
+		for(auto& name : metadata.imports) {
+			fmt::print("    import: {}\n", name);
+		}
+		for(auto& name : metadata.exports) {
+			fmt::print("    export: {}\n", name);
+		}
+		fmt::print("    features: {:#x}\n", metadata.features);
 	} else if(run_sub) {
 		std::vector<uint8_t> optimized_wasm_bytes;
 		if(!qr_path_run.empty()) {
 			start = std::chrono::high_resolution_clock::now();
-			Mni::Import::ScanQRCode(optimized_wasm_bytes, qr_path_run);
+			if(!Mni::Import::ScanQRCode(optimized_wasm_bytes, qr_path_run)) {
+				std::cerr << "QR code could not be read or is corrupt" << std::endl;
+				exit(1);
+			}
 			stop = std::chrono::high_resolution_clock::now();
 			time_taken
 				= std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
@@ -165,18 +403,27 @@ int main(int argc, char** argv) {
 
 		start = std::chrono::high_resolution_clock::now();
 		std::vector<uint8_t> wasm_bytes;
-		auto size  = Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, optimized_wasm_bytes);
+		std::vector<Mni::Wasm::ActiveSegment> segments;
+		auto size  = Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, optimized_wasm_bytes, segments);
 		stop       = std::chrono::high_resolution_clock::now();
 		time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
 		fmt::print("Input wasm: {} bytes ({}ms)\n", wasm_bytes.size(), time_taken);
 
+		if(size == 0) {
+			std::cerr << "Optimized webassembly is corrupt or of another version" << std::endl;
+			exit(1);
+		}
+
 		std::vector<std::string> exported_functions;
-		Mni::Wasm::GetExports(wasm_bytes, exported_functions);
+		if(!Mni::Wasm::GetExports(wasm_bytes, exported_functions)) {
+			std::cerr << "Could not read the exports of the webassembly" << std::endl;
+			exit(1);
+		}
 		for(auto& name : exported_functions) {
 			fmt::print("    {}\n", name);
 		}
 
-		Mni::Wasm::Runtime runtime(wasm_bytes);
+		Mni::Wasm::Runtime runtime(wasm_bytes, std::move(segments));
 
 		if(!runtime.PrepareWasm()) {
 			return -1;
@@ -187,6 +434,38 @@ int main(int argc, char** argv) {
 		while(runtime.TickWindow())
 			std::this_thread::sleep_for(std::chrono::milliseconds(10));
 		runtime.Close();
+	} else if(dump_sub) {
+		std::vector<uint8_t> wasm_bytes;
+		if(!qr_path_dump.empty()) {
+			if(!Mni::Import::ScanQRCode(wasm_bytes, qr_path_dump)) {
+				std::cerr << "QR code could not be read or is corrupt" << std::endl;
+				exit(1);
+			}
+		} else if(!wasm_input_dump.empty()) {
+			std::ifstream wasm_file(wasm_input_dump, std::ios::binary);
+			wasm_bytes = std::vector<uint8_t>(
+				(std::istreambuf_iterator<char>(wasm_file)), std::istreambuf_iterator<char>());
+		}
+
+		start = std::chrono::high_resolution_clock::now();
+		Mni::Parser parser(wasm_bytes.data(), wasm_bytes.size());
+		stop       = std::chrono::high_resolution_clock::now();
+		time_taken = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+
+		// Bit offset, bits used and name of every item
+		uint64_t item_bits = 0;
+		for(auto item : parser) {
+			fmt::print("{:>10} {:>6}  {}\n", item.bit, item.bits, item.name);
+			item_bits += item.bits;
+		}
+		fmt::print("{} {} items, {} of {} bits in items ({}us)\n",
+			parser.IsOptimized() ? "Optimized" : "Normal", parser.NumItems(), item_bits,
+			parser.GetSize(), time_taken);
+
+		if(!parser.IsValid()) {
+			std::cerr << "Optimized webassembly is corrupt or of another version" << std::endl;
+			exit(1);
+		}
 	}
 
 	return 0;
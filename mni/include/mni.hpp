@@ -2,13 +2,18 @@
 
 #include <mni/decoding.hpp>
 #include <mni/encoding.hpp>
+#include <mni/lz.hpp>
 #include <mni/tree.hpp>
 #include <mni/wasm/parser.hpp>
 #include <mni/wasm/runtime.hpp>
 
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <filesystem>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 
@@ -21,27 +26,142 @@ namespace Mni {
 			std::vector<uint8_t>& bytes1, std::vector<uint8_t>& bytes2, uint64_t size);
 	}
 
+	// Disassembler listing every item of normal or optimized webassembly with its bits
+	// The stream is read once into a compact trace, names are views into static tables
 	class Parser {
 	public:
+		struct Item {
+			Wasm::WasmItemType type;
+			std::string_view name;
+			uint64_t bit;
+			uint64_t bits;
+		};
+
+		class Iterator {
+		public:
+			Iterator(std::vector<Wasm::TracedItem>::const_iterator it)
+				: it(it) { }
+
+			Item operator*() const {
+				return { it->type, Wasm::ItemName(*it), it->bit, it->bits };
+			}
+			Iterator& operator++() {
+				++it;
+				return *this;
+			}
+			bool operator!=(const Iterator& other) const {
+				return it != other.it;
+			}
+
+		private:
+			std::vector<Wasm::TracedItem>::const_iterator it;
+		};
+
+		// Optimized webassembly is detected by the missing magic
 		Parser(uint8_t* buf, size_t size);
+		Iterator begin() const {
+			return Iterator(trace.begin());
+		}
+		Iterator end() const {
+			return Iterator(trace.end());
+		}
+		size_t NumItems() const {
+			return trace.size();
+		}
+		bool IsOptimized() const {
+			return optimized;
+		}
+		// False if the stream is damaged, items read until then are still listed
+		bool IsValid() const {
+			return valid;
+		}
+		// Bits of the whole stream, including headers that are not items
+		uint64_t GetSize() const {
+			return bytes.size() * 8;
+		}
 		std::vector<std::string> GetInstructionStrings();
 
 	private:
-		std::vector<std::string> instructions;
+		std::vector<uint8_t> bytes;
+		std::vector<Wasm::TracedItem> trace;
+		bool optimized;
+		bool valid;
 	};
 
 	namespace Wasm {
+		// Measured after every round of optimization passes
+		struct ShrinkRound {
+			// Functions the function passes ran on
+			uint32_t functions;
+			// Size estimate after the round, see EstimateSize
+			uint64_t estimate;
+			std::chrono::microseconds time;
+		};
+
+		// Optimized bits of a pipeline tried by the search, UINT64_MAX if it was skipped
+		struct SearchResult {
+			std::string_view pipeline;
+			uint64_t bits;
+		};
+
+		struct ShrinkOptions {
+			// Rounds of passes at most, 0 runs until the module stops shrinking
+			uint32_t max_rounds = 0;
+			// No round is started that would likely end past this, 0 is unlimited
+			// The first round always runs, with search this holds for every pipeline
+			std::chrono::milliseconds time_budget { 0 };
+			std::vector<ShrinkRound>* rounds = nullptr;
+			// Try several pass pipelines and keep the one with the fewest optimized bits
+			bool search = false;
+			// Skip the remaining pipelines once one fits this QR code version, 0 tries all
+			uint8_t target_version = 0;
+			// Settings the candidates are encoded with to count their bits
+			OptimizedOptions encoding;
+			std::vector<SearchResult>* searched = nullptr;
+		};
+
+		// Replaces out with the optimized module, exports receives its function exports
 		void RemoveUnneccesary(std::vector<uint8_t>& in, std::vector<uint8_t>& out,
-			std::unordered_map<int, std::string> kept_names);
-		void GetExports(std::vector<uint8_t>& in, std::vector<std::string>& names);
+			std::span<const std::string_view> kept_names,
+			std::vector<std::string>* exports = nullptr, const ShrinkOptions& options = {});
+		// Function exports of normal or optimized webassembly, without building the module
+		bool GetExports(std::vector<uint8_t>& in, std::vector<std::string>& names);
 	}
 
 	namespace Export {
+		// Smallest QR code version holding size bits, 0 if none does
+		uint8_t QRVersion(uint64_t size);
 		bool GenerateQRCode(
 			uint64_t size, std::vector<uint8_t>& bytes, int width, int height, std::string path);
 	}
 
 	namespace Import {
-		void ScanQRCode(std::vector<uint8_t>& bytes, std::string path);
+		// Returns false if no code was found or its payload is corrupt
+		bool ScanQRCode(std::vector<uint8_t>& bytes, std::string path);
+	}
+
+	// Compile results on disk, keyed by everything that decides them
+	namespace Cache {
+		struct Entry {
+			// Purged module and its function exports
+			std::vector<uint8_t> wasm;
+			std::vector<std::string> exports;
+			// Optimized stream and its exact size in bits
+			std::vector<uint8_t> optimized;
+			uint64_t size = 0;
+			// QR code image, empty if none was generated
+			std::vector<uint8_t> qr_png;
+		};
+
+		// MNI_CACHE_DIR, otherwise mni in the user's cache directory
+		std::filesystem::path DefaultDirectory();
+		// Hash of the input, the options changing the output and the stream versions
+		std::string Key(std::span<const uint8_t> wasm_bytes, std::string_view options);
+		// Marks the entry as recently used, returns false if there is none
+		bool Load(const std::filesystem::path& dir, const std::string& key, Entry& entry);
+		// Replaces the entry atomically, then removes the least recently used entries
+		// until the cache is at most max_bytes
+		bool Store(const std::filesystem::path& dir, const std::string& key, const Entry& entry,
+			uint64_t max_bytes);
 	}
 }
\ No newline at end of file
@@ -3,7 +3,9 @@
 #include <mni/encoding.hpp>
 #include <mni/tree.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
@@ -12,6 +14,8 @@ namespace Mni {
 		static constexpr uint8_t DEFAULT_LEB_MULTIPLE = 7;
 
 		uint64_t Read1Bit(bool* bit_out, uint64_t current_bit, std::vector<uint8_t>& bytes);
+		// CRC-16/CCITT of size bits starting at current_bit, the last byte padded with zeros
+		uint16_t Crc16(uint64_t current_bit, uint64_t size, std::vector<uint8_t>& bytes);
 		uint64_t ReadFloat(float* num_out, uint8_t removed_mantissa_bits, uint64_t current_bit,
 			std::vector<uint8_t>& bytes);
 		uint64_t ReadDouble(double* num_out, uint8_t removed_mantissa_bits, uint64_t current_bit,
@@ -22,25 +26,23 @@ namespace Mni {
 			return ReadLEBUnsigned(size_out, DEFAULT_LEB_MULTIPLE, current_bit, bytes);
 		}
 
+		// Bits past the end of bytes read as zero, so damaged streams can't read out of bounds
 		template <typename T>
-		uint64_t ReadNum(
+		uint64_t ReadNumUnsigned(
 			T* num_out, uint8_t bit_size, uint64_t current_bit, std::vector<uint8_t>& bytes) {
 			static_assert(std::is_integral<T>::value, "Must be passed integral type");
 
-			bool is_negative;
-			current_bit = Read1Bit(&is_negative, current_bit, bytes);
-
-			T out = 0;
+			// Up to a byte at a time
+			uint64_t out = 0;
 			while(bit_size != 0) {
-				out <<= 1;
-				out |= (bytes[current_bit >> 3] << (current_bit % 8) & 0b10000000 ? 0x1 : 0x0);
-
-				current_bit++;
-				bit_size--;
-			}
-
-			if(is_negative) {
-				out *= -1;
+				uint64_t byte  = current_bit >> 3;
+				uint8_t offset = current_bit % 8;
+				uint8_t count  = std::min<uint8_t>(8 - offset, bit_size);
+				uint8_t bits   = byte < bytes.size() ? bytes[byte] << offset : 0;
+				out            = (out << count) | (bits >> (8 - count));
+
+				current_bit += count;
+				bit_size -= count;
 			}
 
 			*num_out = out;
@@ -48,17 +50,17 @@ namespace Mni {
 		}
 
 		template <typename T>
-		uint64_t ReadNumUnsigned(
+		uint64_t ReadNum(
 			T* num_out, uint8_t bit_size, uint64_t current_bit, std::vector<uint8_t>& bytes) {
 			static_assert(std::is_integral<T>::value, "Must be passed integral type");
 
-			T out = 0;
-			while(bit_size != 0) {
-				out <<= 1;
-				out |= (bytes[current_bit >> 3] << (current_bit % 8) & 0b10000000 ? 0x1 : 0x0);
+			bool is_negative;
+			current_bit = Read1Bit(&is_negative, current_bit, bytes);
 
-				current_bit++;
-				bit_size--;
+			T out;
+			current_bit = ReadNumUnsigned(&out, bit_size, current_bit, bytes);
+			if(is_negative) {
+				out *= -1;
 			}
 
 			*num_out = out;
@@ -93,7 +95,8 @@ namespace Mni {
 			current_bit            = Read1Bit(&is_negative, current_bit, bytes);
 			*num_out               = 0;
 			uint8_t current_offset = 0;
-			while(true) {
+			// Values never need more parts than fit in T, longer LEBs are damaged
+			while(current_offset < sizeof(T) * 8) {
 				T part;
 				current_bit = ReadNumUnsigned(&part, multiple_bits, current_bit, bytes);
 				*num_out |= part << current_offset;
@@ -120,7 +123,8 @@ namespace Mni {
 
 			*num_out               = 0;
 			uint8_t current_offset = 0;
-			while(true) {
+			// Values never need more parts than fit in T, longer LEBs are damaged
+			while(current_offset < sizeof(T) * 8) {
 				T part;
 				current_bit = ReadNumUnsigned(&part, multiple_bits, current_bit, bytes);
 				*num_out |= (part << current_offset);
@@ -147,14 +151,41 @@ namespace Mni {
 				} else {
 					// Still reading path
 					bool direction;
-					current_bit = Read1Bit(&direction, current_bit, bytes);
-					if(direction) {
-						root = root->right;
-					} else {
-						root = root->left;
+					current_bit              = Read1Bit(&direction, current_bit, bytes);
+					Mni::Tree::Node<T>* next = direction ? root->right : root->left;
+					if(next == NULL) {
+						// Missing branch of a damaged tree
+						*num_out = root->data;
+						return current_bit;
 					}
+					root = next;
+				}
+			}
+		}
+
+		template <typename T>
+		uint64_t ReadHuffmanValue(std::span<const Mni::Tree::FlatNode<T>> nodes, T* num_out,
+			uint64_t current_bit, std::vector<uint8_t>& bytes) {
+			uint32_t node = 0;
+			while(!nodes[node].IsLeaf()) {
+				bool direction;
+				current_bit = Read1Bit(&direction, current_bit, bytes);
+				node        = nodes[node].children[direction];
+				// Missing branch of a damaged table, children always come after their parent
+				if(node == 0) {
+					break;
 				}
 			}
+
+			*num_out = nodes[node].data;
+			return current_bit;
+		}
+
+		template <typename T>
+		uint64_t ReadHuffmanValue(std::vector<Mni::Tree::FlatNode<T>>& nodes, T* num_out,
+			uint64_t current_bit, std::vector<uint8_t>& bytes) {
+			return ReadHuffmanValue<T>(
+				std::span<const Mni::Tree::FlatNode<T>>(nodes), num_out, current_bit, bytes);
 		}
 
 		template <typename T>
@@ -199,6 +230,11 @@ namespace Mni {
 			current_bit = ReadNumUnsigned(&list_size, Encoding::LIST_SIZE_BITS, current_bit, bytes);
 			bool every_element_positive;
 			current_bit = Read1Bit(&every_element_positive, current_bit, bytes);
+			// Only lists of zeros can have more elements than bits left, which are never
+			// written, so longer lists are damaged
+			if(current_bit + list_size > bytes.size() * 8) {
+				list_size = 0;
+			}
 
 			if(list_type == Encoding::FIXED) {
 				uint8_t bit_size;
@@ -291,6 +327,40 @@ namespace Mni {
 			return current_bit;
 		}
 
+		template <typename T>
+		uint64_t ReadHuffmanHeader(std::vector<Mni::Tree::FlatNode<T>>& nodes, uint64_t current_bit,
+			std::vector<uint8_t>& bytes) {
+			std::vector<T> elements;
+			current_bit = ReadSimpleIntegerList(elements, current_bit, bytes);
+
+			// Every element adds at most bit_size nodes, reserve for the common case
+			nodes.clear();
+			nodes.reserve(elements.size() * 2);
+			nodes.emplace_back();
+
+			for(size_t i = 0; i < elements.size(); i++) {
+				uint64_t representation;
+				uint8_t bit_size;
+				current_bit = ReadNumUnsigned(&bit_size, 6, current_bit, bytes);
+				current_bit = ReadNumUnsigned(&representation, bit_size, current_bit, bytes);
+
+				uint32_t node = 0;
+				for(int8_t bit = bit_size - 1; bit > -1; bit--) {
+					bool direction = representation & (1ULL << bit);
+					if(!nodes[node].children[direction]) {
+						nodes[node].children[direction] = nodes.size();
+						nodes.emplace_back();
+					}
+					node = nodes[node].children[direction];
+				}
+
+				// Single element tables have a root leaf with a 0 bit representation
+				nodes[node].data = elements[i];
+			}
+
+			return current_bit;
+		}
+
 		template <typename T>
 		uint64_t ReadHuffmanIntegerList(
 			std::vector<T>& data_out, uint64_t current_bit, std::vector<uint8_t>& bytes) {
@@ -2,6 +2,7 @@
 
 #include <mni/tree.hpp>
 
+#include <algorithm>
 #include <bit>
 #include <cstdint>
 #include <limits>
@@ -69,6 +70,11 @@ namespace Mni {
 				num = std::abs(num);
 			}
 
+			// Shifting by the whole type size is undefined
+			if(bit_size == 0) {
+				return current_bit;
+			}
+
 			constexpr uint8_t type_size = sizeof(T) * 8;
 			T num_to_write              = num << (type_size - bit_size);
 			while(bit_size != 0) {
@@ -371,22 +377,19 @@ namespace Mni {
 			return current_bit;
 		}
 
-		template <typename T>
-		uint64_t WriteHuffmanHeader(std::vector<T> data,
-			std::unordered_map<T, Mni::Tree::NodeRepresentation>& rep_map, uint64_t current_bit,
-			std::vector<uint8_t>& bytes) {
-			Mni::Tree::GenerateHuffman(data, rep_map);
-			return WriteHuffmanHeader(rep_map, current_bit, bytes);
-		}
-
 		template <typename T>
 		uint64_t WriteHuffmanHeader(std::unordered_map<T, Mni::Tree::NodeRepresentation>& rep_map,
 			uint64_t current_bit, std::vector<uint8_t>& bytes) {
 			std::vector<T> element_list;
-			std::vector<Mni::Tree::NodeRepresentation> representation_list;
 			for(auto& element : rep_map) {
 				element_list.push_back(element.first);
-				representation_list.push_back(element.second);
+			}
+
+			// Sorted elements are deterministic and compress better with delta list encodings
+			std::sort(element_list.begin(), element_list.end());
+			std::vector<Mni::Tree::NodeRepresentation> representation_list;
+			for(auto& element : element_list) {
+				representation_list.push_back(rep_map.at(element));
 			}
 
 			current_bit = WriteSimpleIntegerList(element_list, current_bit, bytes);
@@ -401,6 +404,14 @@ namespace Mni {
 			return current_bit;
 		}
 
+		template <typename T>
+		uint64_t WriteHuffmanHeader(std::vector<T> data,
+			std::unordered_map<T, Mni::Tree::NodeRepresentation>& rep_map, uint64_t current_bit,
+			std::vector<uint8_t>& bytes) {
+			Mni::Tree::GenerateHuffman(data, rep_map);
+			return WriteHuffmanHeader(rep_map, current_bit, bytes);
+		}
+
 		template <typename T>
 		uint64_t WriteHuffmanIntegerList(
 			std::vector<T> data, uint64_t current_bit, std::vector<uint8_t>& bytes) {
@@ -428,6 +439,9 @@ namespace Mni {
 			uint64_t start, uint64_t end, uint64_t new_start, std::vector<uint8_t>& bytes);
 		uint64_t CopyBits(uint64_t start, uint64_t end, uint64_t new_start,
 			std::vector<uint8_t>& bytes_src, std::vector<uint8_t>& bytes_dest);
+		// Destination must already hold new_start + end - start bits
+		uint64_t CopyBits(uint64_t start, uint64_t end, uint64_t new_start, const uint8_t* src,
+			uint8_t* dest);
 
 		// Compression type in stream, handles 4 types
 		static constexpr uint8_t COMPRESSION_TYPE_BITS = 3;
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Mni {
+	namespace Lz {
+		// Shorter runs and matches are cheaper as literals
+		static constexpr uint32_t MIN_ZERO_RUN = 4;
+		static constexpr uint32_t MIN_MATCH    = 4;
+		// Candidates checked per position, bounds encoding time on repetitive data
+		static constexpr uint32_t MAX_CHAIN = 32;
+
+		enum TokenType : uint8_t {
+			LITERAL,  // Single byte
+			ZERO_RUN, // Run of zero bytes, common in padding
+			MATCH,    // Copy of earlier bytes
+		};
+
+		struct Token {
+			TokenType type;
+			uint8_t literal;
+			uint32_t length;
+			uint32_t distance;
+		};
+
+		// Preset bytes placed before the data that matches can refer back into
+		// Indexed once on construction, read only afterwards so it can be shared by threads
+		class Dictionary {
+		public:
+			Dictionary(std::span<const uint8_t> bytes);
+
+			std::span<const uint8_t> bytes;
+			std::vector<int64_t> head;
+			std::vector<int64_t> prev;
+		};
+
+		// Greedy parse of data into literals, zero runs and back references
+		std::vector<Token> Parse(
+			std::span<const uint8_t> data, const Dictionary* dictionary = nullptr);
+
+		// Append length bytes starting distance bytes back, continuing into the end of the
+		// dictionary when distance is larger than out, returns false if out of range
+		bool AppendMatch(std::vector<uint8_t>& out, size_t distance, size_t length,
+			std::span<const uint8_t> dictionary = {});
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace Mni {
+	namespace Parallel {
+		// Call func(i) for every i in [0, count) using up to one thread per core
+		// Indices are handed out in order but may complete in any order
+		template <typename F> void For(size_t count, F&& func) {
+			size_t num_threads
+				= std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1U), count);
+			if(num_threads <= 1) {
+				for(size_t i = 0; i < count; i++) {
+					func(i);
+				}
+				return;
+			}
+
+			std::atomic<size_t> next { 0 };
+			std::vector<std::thread> threads;
+			for(size_t t = 0; t < num_threads; t++) {
+				threads.emplace_back([&]() {
+					size_t i;
+					while((i = next++) < count) {
+						func(i);
+					}
+				});
+			}
+
+			for(auto& thread : threads) {
+				thread.join();
+			}
+		}
+	}
+}
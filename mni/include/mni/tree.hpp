@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <queue>
@@ -38,6 +39,17 @@ namespace Mni {
 			}
 		};
 
+		// Node stored in a flat array, built once when a table is read
+		// Child index 0 means no child, the root is never a child of another node
+		template <typename T> struct FlatNode {
+			T data { 0 };
+			uint32_t children[2] { 0, 0 };
+
+			bool IsLeaf() const {
+				return children[0] == 0 && children[1] == 0;
+			}
+		};
+
 		template <typename T, typename P> void PrintTree(Node<T>* root, std::string str) {
 			if(!root) {
 				return;
@@ -75,6 +87,14 @@ namespace Mni {
 				element_frequencies_list.push_back(element.second);
 			}
 
+			if(element_frequencies_list.empty()) {
+				return;
+			}
+
+			// Sort so the same frequencies always produce the same tree, regardless of map order
+			std::sort(element_frequencies_list.begin(), element_frequencies_list.end(),
+				[](const Node<T>& left, const Node<T>& right) { return left.data < right.data; });
+
 			Node<T>* root = BuildHuffman(element_frequencies_list);
 			BuildRepresentation(root, rep_map);
 			FreeTree(root);
@@ -87,7 +107,7 @@ namespace Mni {
 				return;
 			}
 
-			if(root->data != 0) {
+			if(!root->left && !root->right) {
 				// std::string rep_string = std::bitset<64>(rep.representation).to_string();
 				// std::cout << (char)root->data << ": " << rep_string.substr(rep_string.size() -
 				// rep.bit_size)
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <mni/lz.hpp>
+
+#include <cstdint>
+
+namespace Mni {
+	namespace Wasm {
+		// Version written into new codes, 0 means no dictionary
+		// Published versions must never change, add a new version instead
+		static constexpr uint8_t DICTIONARY_VERSION      = 1;
+		static constexpr uint8_t DICTIONARY_VERSION_BITS = 3;
+
+		// Preset dictionary for strings and data, nullptr if the version is unknown or 0
+		const Mni::Lz::Dictionary* PresetDictionary(uint8_t version);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mni/wasm/imports.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+namespace Mni {
+	namespace Wasm {
+		// Runtime function names by id, and by name through a sorted copy
+		// Built at compile time, so there is no static initialization
+		template <size_t N> struct FunctionTable {
+			std::array<std::string_view, N> names {};
+			std::array<std::pair<std::string_view, int32_t>, N> sorted {};
+
+			constexpr bool Contains(uint32_t id) const {
+				return id < N;
+			}
+
+			constexpr std::string_view Name(uint32_t id) const {
+				return names[id];
+			}
+
+			// Id of a function name, -1 if the runtime does not define it
+			constexpr int32_t Find(std::string_view name) const {
+				auto entry = std::lower_bound(sorted.begin(), sorted.end(), name,
+					[](const auto& entry, std::string_view name) { return entry.first < name; });
+				return entry != sorted.end() && entry->first == name ? entry->second : -1;
+			}
+		};
+
+		template <size_t N>
+		constexpr FunctionTable<N> MakeFunctionTable(
+			const std::pair<int32_t, std::string_view> (&functions)[N]) {
+			FunctionTable<N> table;
+			for(size_t i = 0; i < N; i++) {
+				// Ids have to be dense, out of range ids fail to compile
+				table.names[functions[i].first] = functions[i].second;
+				table.sorted[i] = { functions[i].second, functions[i].first };
+			}
+			std::sort(table.sorted.begin(), table.sorted.end());
+			return table;
+		}
+
+		inline constexpr std::pair<int32_t, std::string_view> INCLUDED_FUNCTIONS[]
+			= MNI_INCLUDED_FUNCTIONS;
+		inline constexpr auto DEFINED_FUNCTIONS = MakeFunctionTable(INCLUDED_FUNCTIONS);
+		static_assert(std::ranges::none_of(
+			DEFINED_FUNCTIONS.names, [](std::string_view name) { return name.empty(); }));
+	}
+}
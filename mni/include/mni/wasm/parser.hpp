@@ -1,7 +1,17 @@
 #pragma once
 
+#include <mni/decoding.hpp>
+#include <mni/encoding.hpp>
+#include <mni/tree.hpp>
+#include <mni/wasm/dictionary.hpp>
+#include <mni/wasm/tables.hpp>
+
+#include <array>
 #include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -18,6 +28,7 @@ namespace Mni {
 			MEMORY_OP,     // For memory related operations
 			INSTRUCTION,   // Instruction
 			INSTRUCTION32, // Additional instructions
+			BLOCK_OPCODE,  // Instruction inside a block, only used to select its table
 			ATTRIBUTE,     // Attribute / Mutability
 			BREAK,         // Break offset, used in switch
 			FUNCTION,      // Function index
@@ -39,25 +50,298 @@ namespace Mni {
 			EXTERNAL,      // Kind of external
 			FLAGS,         // Used in some places
 			DATA,          // Includes segments and user data
+			ENCODED,       // Already optimized bits, such as bodies encoded in parallel
+		};
+
+		// Substreams used when the optimized stream is split into columns
+		enum WasmColumn : uint8_t {
+			COLUMN_OPCODE,  // Instructions, sections, kinds and flags
+			COLUMN_INDEX,   // Type, function, local, global and other indices
+			COLUMN_LITERAL, // Constants and memory immediates
+			COLUMN_SIZE,    // Counts, sizes and limits
+			COLUMN_DATA,    // Strings and raw data
+			NUM_COLUMNS,
 		};
 
-		class Huffman {
+		constexpr WasmColumn ColumnOf(WasmItemType type) {
+			switch(type) {
+			case SECTION:
+			case INSTRUCTION:
+			case INSTRUCTION32:
+			case BLOCK_OPCODE:
+			case ATTRIBUTE:
+			case ATOMIC_ORDER:
+			case MEMORY_IDX:
+			case EXTERNAL:
+			case FLAGS:
+				return COLUMN_OPCODE;
+			case TYPE:
+			case INDEXED_TYPE:
+			case BREAK:
+			case FUNCTION:
+			case TABLE:
+			case LOCAL:
+			case GLOBAL:
+			case MEMORY:
+			case TAG:
+			case SEGMENT:
+			case LANE:
+			case STRUCT:
+				return COLUMN_INDEX;
+			case MEMORY_OP:
+			case I32:
+			case I64:
+			case I128:
+			case F32:
+			case F64:
+				return COLUMN_LITERAL;
+			case NUM:
+			case SIZE:
+			case LIMIT:
+				return COLUMN_SIZE;
+			case STRING:
+			case DATA:
+			case ENCODED:
+				return COLUMN_DATA;
+			}
+			return COLUMN_OPCODE;
+		}
+
+		// Entropy table for a single item type
+		// Frequencies are collected while reading normal webassembly and the table is only
+		// emitted when the header and codes are smaller than the raw encoding
+		template <typename T> class HuffmanTable {
 		public:
-			Huffman() { }
+			bool construct = false;
+			std::unordered_map<T, Tree::Node<T>> frequencies;
+			bool rep = false;
+			std::unordered_map<T, Tree::NodeRepresentation> rep_map;
+			bool tree = false;
+			std::vector<Tree::FlatNode<T>> nodes;
+			// Built-in table chosen instead of emitting one in the header
+			bool builtin = false;
+			// Bits used by every counted value with the chosen coding, including the header
+			uint64_t size = 0;
+
+			void AddFrequency(T value) {
+				if(frequencies.count(value)) {
+					frequencies[value].freq++;
+				} else {
+					frequencies[value] = Tree::Node(value, 1);
+				}
+			}
+
+			void Merge(HuffmanTable& other) {
+				if(!construct) {
+					return;
+				}
+				for(auto& [value, node] : other.frequencies) {
+					if(frequencies.count(value)) {
+						frequencies[value].freq += node.freq;
+					} else {
+						frequencies[value] = Tree::Node(value, node.freq);
+					}
+				}
+			}
+
+			// raw_bits returns the number of bits a value uses without this table
+			// builtin_rep is used instead of the generated table if it covers every value and
+			// is smaller
+			template <typename F>
+			void GenerateRep(F raw_bits,
+				const std::unordered_map<T, Tree::NodeRepresentation>* builtin_rep = nullptr) {
+				rep_map.clear();
+				builtin = false;
+				Tree::GenerateHuffmanFrequencies(frequencies, rep_map);
+				if(rep_map.empty()) {
+					rep  = false;
+					size = 0;
+					return;
+				}
 
-			// INSTRUCTION huffman
-			bool INSTRUCTION_construct = false;
-			std::unordered_map<uint8_t, Tree::Node<uint8_t>> INSTRUCTION_frequencies;
-			bool INSTRUCTION_rep = false;
-			std::unordered_map<uint8_t, Tree::NodeRepresentation> INSTRUCTION_rep_map;
-			bool INSTRUCTION_tree                      = false;
-			Mni::Tree::Node<uint8_t>* INSTRUCTION_root = new Mni::Tree::Node<uint8_t>();
-			void INSTRUCTION_generate_rep() {
-				GenerateHuffmanFrequencies(INSTRUCTION_frequencies, INSTRUCTION_rep_map);
-				INSTRUCTION_rep = true;
+				std::vector<uint8_t> header;
+				uint64_t huffman_size = Encoding::WriteHuffmanHeader(rep_map, 0, header);
+				uint64_t raw_size     = 0;
+				uint64_t builtin_size = 0;
+				bool builtin_covers   = builtin_rep != nullptr;
+				for(auto& [value, node] : frequencies) {
+					huffman_size += node.freq * rep_map[value].bit_size;
+					raw_size += node.freq * raw_bits(value);
+					if(builtin_covers && builtin_rep->contains(value)) {
+						builtin_size += node.freq * builtin_rep->at(value).bit_size;
+					} else {
+						builtin_covers = false;
+					}
+				}
+
+				if(builtin_covers && builtin_size <= huffman_size && builtin_size < raw_size) {
+					rep     = true;
+					builtin = true;
+					rep_map = *builtin_rep;
+					size    = builtin_size;
+				} else {
+					rep  = huffman_size < raw_size;
+					size = std::min(huffman_size, raw_size);
+				}
 			}
 		};
 
+		// Value type stored in the table for each item type
+		template <WasmItemType type> struct HuffmanValue {
+			using T = uint32_t;
+		};
+		template <> struct HuffmanValue<INSTRUCTION> {
+			using T = uint8_t;
+		};
+		template <> struct HuffmanValue<BLOCK_OPCODE> {
+			using T = uint8_t;
+		};
+		template <> struct HuffmanValue<TYPE> {
+			using T = int32_t;
+		};
+		// Literal bytes left over after LZ compression
+		template <> struct HuffmanValue<DATA> {
+			using T = uint8_t;
+		};
+
+		// Built-in table for an item type, selected by a single header bit
+		template <WasmItemType type> struct HuffmanBuiltin {
+			static constexpr bool available = false;
+		};
+		template <> struct HuffmanBuiltin<INSTRUCTION> {
+			static constexpr bool available = true;
+			static constexpr auto& table    = INSTRUCTION_TABLE;
+		};
+		template <> struct HuffmanBuiltin<BLOCK_OPCODE> {
+			static constexpr bool available = true;
+			static constexpr auto& table    = BLOCK_OPCODE_TABLE;
+		};
+		template <> struct HuffmanBuiltin<LOCAL> {
+			static constexpr bool available = true;
+			static constexpr auto& table    = LOCAL_TABLE;
+		};
+		template <> struct HuffmanBuiltin<BREAK> {
+			static constexpr bool available = true;
+			static constexpr auto& table    = BREAK_TABLE;
+		};
+		template <> struct HuffmanBuiltin<MEMORY_OP> {
+			static constexpr bool available = true;
+			static constexpr auto& table    = ALIGN_TABLE;
+		};
+		template <> struct HuffmanBuiltin<DATA> {
+			static constexpr bool available = true;
+			static constexpr auto& table    = DATA_TABLE;
+		};
+
+		// Tables keyed by item type, emitted into the header in template order
+		template <WasmItemType... types> class HuffmanRegistry {
+		public:
+			HuffmanRegistry() { }
+
+			template <WasmItemType type> HuffmanTable<typename HuffmanValue<type>::T>& Get() {
+				return std::get<IndexOf<type>()>(tables);
+			}
+
+			template <WasmItemType type> void Count(typename HuffmanValue<type>::T value) {
+				auto& table = Get<type>();
+				if(table.construct) {
+					table.AddFrequency(value);
+				}
+			}
+
+			void SetConstruct(bool construct) {
+				(void(Get<types>().construct = construct), ...);
+			}
+
+			// Add frequencies counted by another registry, such as one used by a single thread
+			void Merge(HuffmanRegistry& other) {
+				(Get<types>().Merge(other.template Get<types>()), ...);
+			}
+
+			// Call func.template operator()<type>(table) for every table
+			template <typename F> void ForEach(F&& func) {
+				(func.template operator()<types>(Get<types>()), ...);
+			}
+
+		private:
+			template <WasmItemType type> static constexpr size_t IndexOf() {
+				constexpr WasmItemType order[] = { types... };
+				for(size_t i = 0; i < sizeof...(types); i++) {
+					if(order[i] == type) {
+						return i;
+					}
+				}
+				return sizeof...(types);
+			}
+
+			std::tuple<HuffmanTable<typename HuffmanValue<types>::T>...> tables;
+		};
+
+		// MEMORY_OP only uses the table for alignment, offsets are written raw
+		using Huffman = HuffmanRegistry<INSTRUCTION, BLOCK_OPCODE, INSTRUCTION32, TYPE, LOCAL,
+			GLOBAL, FUNCTION, BREAK, MEMORY_OP, DATA>;
+
+		enum MetadataFeature : uint32_t {
+			FEATURE_MISC    = 1 << 0, // Bulk memory and saturating conversions
+			FEATURE_SIMD    = 1 << 1,
+			FEATURE_ATOMICS = 1 << 2,
+			FEATURE_GC      = 1 << 3,
+		};
+
+		// Information about a module that can be read without decoding or instantiating it
+		struct Metadata {
+			std::string name;
+			// Initial size set by mni_prepare through mni_set_bounds
+			uint32_t width { 512 };
+			uint32_t height { 512 };
+			// Names of every imported function
+			std::vector<std::string> imports;
+			// Names of every exported function, runtime functions first in id order
+			std::vector<std::string> exports;
+			// MetadataFeature bits
+			uint32_t features { 0 };
+		};
+
+		// Limits of bounded reading, far above anything that fits in a QR code
+		static constexpr uint64_t ITEMS_PER_BIT   = 4;
+		static constexpr uint64_t MIN_ITEMS       = 1 << 12;
+		static constexpr uint64_t MAX_DATA_BYTES  = 1 << 24;
+		static constexpr uint32_t MAX_BLOCK_DEPTH = 1024;
+
+		// Every stream starts with its format version, exact length in bits and a checksum
+		// of those bits. Streams of other versions are rejected, not misread
+		static constexpr uint8_t FORMAT_VERSION      = 2;
+		static constexpr uint8_t FORMAT_VERSION_BITS = 4;
+		static constexpr uint8_t CHECKSUM_BITS       = 16;
+
+		// Item read from a stream, recorded at every item boundary while tracing
+		struct TracedItem {
+			WasmItemType type;
+			// Opcode of instructions
+			uint32_t value;
+			// Start within the stream or column the item was read from
+			uint64_t bit;
+			// Bits until the next item of the same stream or column
+			uint64_t bits;
+			// Section id and index of the function body in the code section
+			uint8_t section;
+			uint32_t function;
+		};
+		static constexpr uint32_t NO_FUNCTION = UINT32_MAX;
+		static constexpr uint8_t NUM_SECTIONS = 14;
+
+		// Bits of a traced stream by item type, section and function body
+		struct BitStats {
+			uint64_t total_bits = 0;
+			// Headers, tables and everything else between items
+			uint64_t header_bits = 0;
+			std::array<uint64_t, ENCODED + 1> type_bits {};
+			std::array<uint64_t, ENCODED + 1> type_items {};
+			std::array<uint64_t, NUM_SECTIONS> section_bits {};
+			// By index of the body in the code section
+			std::vector<uint64_t> function_bits;
+		};
+
 		class IO {
 		public:
 			IO(std::vector<uint8_t>& bytes, Huffman& huffman)
@@ -89,10 +373,17 @@ namespace Mni {
 			size_t GetPos();
 			void Reset();
 
-			void WriteSlice(std::vector<uint8_t> slice);
-			void WriteString(std::string str);
+			std::vector<uint8_t>& GetBytes() {
+				return bytes;
+			}
+
+			void WriteSlice(std::span<const uint8_t> slice);
+			void WriteString(std::string_view str);
 			std::vector<uint8_t> ReadSlice(size_t len);
 			std::string ReadString();
+			// Views into the underlying bytes, valid until they are resized
+			std::span<const uint8_t> ReadSliceView(size_t len);
+			std::string_view ReadStringView();
 
 			Huffman& huffman;
 
@@ -105,6 +396,7 @@ namespace Mni {
 		public:
 			OptimizedIO(std::vector<uint8_t>& bytes, uint64_t current_bit, Huffman& huffman)
 				: bytes(bytes)
+				, stream(&bytes)
 				, original_current_bit(current_bit)
 				, current_bit(current_bit)
 				, huffman(huffman) { }
@@ -126,21 +418,34 @@ namespace Mni {
 			void WriteUNum(uint64_t num, uint8_t bit_size);
 			uint64_t ReadUNum(uint8_t bit_size);
 
-			void WriteSlice(std::vector<uint8_t>& slice);
-			void WriteString(std::string& str);
+			void WriteSlice(std::span<const uint8_t> slice);
+			void WriteString(std::string_view str);
 			std::vector<uint8_t> ReadSlice(size_t len);
 			std::string ReadString(size_t len);
+			// Data prefixed by a bit choosing between raw bytes and LZ tokens
+			void WriteData(std::span<const uint8_t> data);
+			std::vector<uint8_t> ReadData(size_t len);
+			// Append bits written by another OptimizedIO
+			void WriteBits(std::vector<uint8_t>& src, uint64_t bits);
 
-			void ReadSize() {
-				size = ReadULEB();
-				// Webassembly starts after size is read
-				original_current_bit = current_bit;
-			}
-			void PrependSize();
+			// Returns false if the version or checksum doesn't match
+			bool ReadHeader();
+			void PrependHeader();
+			// Rewrite the checksum of a stream changed after encoding
+			bool SealHeader();
 			uint64_t GetSize() {
 				return current_bit - original_current_bit;
 			}
 			bool Done() {
+				if(columns_active) {
+					column_state[active_column].current_bit = current_bit;
+					for(auto& column : column_state) {
+						if(column.current_bit != column.end_bit) {
+							return false;
+						}
+					}
+					return true;
+				}
 				return GetSize() == size;
 			}
 
@@ -153,25 +458,346 @@ namespace Mni {
 
 			template <typename T>
 			void WriteHuffmanHeader(std::unordered_map<T, Mni::Tree::NodeRepresentation>& rep_map) {
-				current_bit = Mni::Encoding::WriteHuffmanHeader(rep_map, current_bit, bytes);
+				current_bit = Mni::Encoding::WriteHuffmanHeader(rep_map, current_bit, *stream);
+			}
+
+			template <typename T> void ReadHuffmanHeader(std::vector<Mni::Tree::FlatNode<T>>& nodes) {
+				current_bit = Mni::Decoding::ReadHuffmanHeader(nodes, current_bit, *stream);
+			}
+
+			template <typename T>
+			void ReadHuffmanValue(std::vector<Mni::Tree::FlatNode<T>>& nodes, T* num_out) {
+				current_bit = Mni::Decoding::ReadHuffmanValue(nodes, num_out, current_bit, *stream);
 			}
 
-			template <typename T> void ReadHuffmanHeader(Mni::Tree::Node<T>* root) {
-				current_bit = Mni::Decoding::ReadHuffmanHeader(root, current_bit, bytes);
+			// One presence bit per table in registry order, then whether the built-in table is
+			// used for types that have one, otherwise followed by the table
+			void WriteHuffmanHeaders() {
+				huffman.ForEach([&]<WasmItemType type>(auto& table) {
+					WriteUNum(table.rep, 1);
+					if(table.rep) {
+						if constexpr(HuffmanBuiltin<type>::available) {
+							WriteUNum(table.builtin, 1);
+						}
+						if(!table.builtin) {
+							WriteHuffmanHeader(table.rep_map);
+						}
+					}
+				});
 			}
 
-			template <typename T> void ReadHuffmanValue(Mni::Tree::Node<T>* root, T* num_out) {
-				current_bit = Mni::Decoding::ReadHuffmanValue(root, num_out, current_bit, bytes);
+			void ReadHuffmanHeaders() {
+				huffman.ForEach([&]<WasmItemType type>(auto& table) {
+					table.tree    = ReadUNum(1);
+					table.builtin = false;
+					if(table.tree) {
+						if constexpr(HuffmanBuiltin<type>::available) {
+							table.builtin = ReadUNum(1);
+						}
+						if(!table.builtin) {
+							ReadHuffmanHeader(table.nodes);
+						}
+					}
+				});
+			}
+
+			// Bits used by a value when no table is emitted for its item type
+			template <WasmItemType type> uint64_t RawBits(typename HuffmanValue<type>::T value) {
+				if constexpr(type == INSTRUCTION || type == BLOCK_OPCODE || type == DATA) {
+					return 8;
+				} else {
+					uint8_t multiple  = columns ? column_state[ColumnOf(type)].leb_multiple
+														: leb_multiple;
+					uint64_t leb_bits = value == 0
+											? multiple + 1
+											: Mni::Encoding::GetRequiredLEBBits(value, multiple);
+					return std::is_signed<typename HuffmanValue<type>::T>::value ? leb_bits + 1
+																				 : leb_bits;
+				}
+			}
+
+			void GenerateHuffmanReps() {
+				huffman.ForEach([&]<WasmItemType type>(auto& table) {
+					auto raw_bits = [&](auto value) { return RawBits<type>(value); };
+					if constexpr(HuffmanBuiltin<type>::available) {
+						static const auto builtin_rep = HuffmanBuiltin<type>::table.RepMap();
+						table.GenerateRep(raw_bits, &builtin_rep);
+					} else {
+						table.GenerateRep(raw_bits);
+					}
+				});
+			}
+
+			template <WasmItemType type> void WriteCoded(typename HuffmanValue<type>::T value) {
+				auto& table = huffman.template Get<type>();
+				if(table.rep) {
+					auto& rep = table.rep_map.at(value);
+					WriteUNum(rep.representation, rep.bit_size);
+				} else if constexpr(type == INSTRUCTION || type == BLOCK_OPCODE || type == DATA) {
+					WriteUNum(value, 8);
+				} else if constexpr(std::is_signed<typename HuffmanValue<type>::T>::value) {
+					WriteLEB(value);
+				} else {
+					WriteULEB(value);
+				}
+			}
+
+			template <WasmItemType type> typename HuffmanValue<type>::T ReadCoded() {
+				auto& table = huffman.template Get<type>();
+				typename HuffmanValue<type>::T value;
+				if(table.tree) {
+					if constexpr(HuffmanBuiltin<type>::available) {
+						if(table.builtin) {
+							// Decoded straight from the compile time tree
+							current_bit = Mni::Decoding::ReadHuffmanValue<
+								typename HuffmanValue<type>::T>(
+								HuffmanBuiltin<type>::table.nodes, &value, current_bit, *stream);
+							return value;
+						}
+					}
+					ReadHuffmanValue(table.nodes, &value);
+				} else if constexpr(type == INSTRUCTION || type == BLOCK_OPCODE || type == DATA) {
+					value = ReadUNum(8);
+				} else if constexpr(std::is_signed<typename HuffmanValue<type>::T>::value) {
+					value = ReadLEB();
+				} else {
+					value = ReadULEB();
+				}
+				return value;
+			}
+
+			// Indices only have tables for some item types
+			void WriteIndex(WasmItemType type, uint32_t index) {
+				switch(type) {
+				case FUNCTION:
+					WriteCoded<FUNCTION>(index);
+					break;
+				case LOCAL:
+					WriteCoded<LOCAL>(index);
+					break;
+				case GLOBAL:
+					WriteCoded<GLOBAL>(index);
+					break;
+				default:
+					WriteULEB(index);
+					break;
+				}
+			}
+
+			uint32_t ReadIndex(WasmItemType type) {
+				switch(type) {
+				case FUNCTION:
+					return ReadCoded<FUNCTION>();
+				case LOCAL:
+					return ReadCoded<LOCAL>();
+				case GLOBAL:
+					return ReadCoded<GLOBAL>();
+				default:
+					return ReadULEB();
+				}
+			}
+
+			// Column mode stores every item type in the substream given by ColumnOf
+			// The header stays in the main stream, followed by the column lengths and the
+			// columns themselves, which are decoded in lockstep
+			void SetColumns(bool enable) {
+				columns = enable;
+			}
+			bool UsesColumns() {
+				return columns;
+			}
+			void SetItemType(WasmItemType type) {
+				if(columns_active) {
+					SwitchColumn(ColumnOf(type));
+				}
+				// Every item starts here, so this is where bounded reading checks its limits
+				failed |= current_bit > end_bit || items_left-- == 0;
+				if(trace) {
+					Trace(type);
+				}
+			}
+
+			// Record every item read into trace, normal_io is the stream of READ_NORMAL
+			void SetTrace(std::vector<TracedItem>* items, IO* normal_io = nullptr) {
+				trace           = items;
+				traced_io       = normal_io;
+				traced_section  = 0;
+				traced_function = NO_FUNCTION;
+				traced_last.fill(SIZE_MAX);
+			}
+			void TraceValue(uint32_t value) {
+				if(trace) {
+					trace->back().value = value;
+				}
+			}
+			// Section and function body of the following items, starting with the section
+			void TraceSection(uint8_t id) {
+				traced_section  = id;
+				traced_function = NO_FUNCTION;
+				if(trace) {
+					trace->back().section  = id;
+					trace->back().function = NO_FUNCTION;
+				}
+			}
+			void TraceFunction(uint32_t function) {
+				traced_function = function;
+			}
+			bool IsTracing() {
+				return trace != nullptr;
+			}
+			// Sets the bits of the last item of every stream, before columns end
+			void EndTrace();
+
+			// Bounded reading for streams that may be damaged, like a bad scan
+			// Reads past end see zero bits and set the error flag at the next item, as does
+			// reading more items than the bits allow. Loops stop once it is set
+			void SetReadLimits(uint64_t end) {
+				end_bit    = end;
+				items_left = MIN_ITEMS + BitsLeft() * ITEMS_PER_BIT;
+				data_left  = MAX_DATA_BYTES;
+			}
+			bool Failed() {
+				return failed;
+			}
+			void Fail() {
+				failed = true;
+			}
+			// Counts larger than this can only come from a damaged stream
+			uint64_t ItemsLeft() {
+				return failed ? 0 : items_left;
+			}
+			uint64_t BitsLeft() {
+				return current_bit < end_bit ? end_bit - current_bit : 0;
+			}
+
+			// Pick the LEB width that minimizes the LEBs written to each column so far
+			std::array<uint8_t, NUM_COLUMNS> ChooseColumnLEBMultiples();
+			void SetColumnLEBMultiples(std::array<uint8_t, NUM_COLUMNS> multiples);
+
+			void WriteColumnHeader();
+			void ReadColumnHeader();
+			void StartColumns();
+			void EndColumns();
+
+			// The final end of every function body is left out while structured, the decoder
+			// places it once the normal bytes of the body are used up
+			void SetStructured(bool enable) {
+				structured = enable;
+			}
+			bool IsStructured() {
+				return structured;
+			}
+			// Instructions inside blocks use the BLOCK_OPCODE table if it has one, merge its
+			// counts into INSTRUCTION when one table is smaller than two
+			void ChooseBlockTable();
+
+			// Optional metadata block at the front of the header, filled in while reading
+			// normal webassembly
+			void SetMetadata(bool enable) {
+				metadata = enable;
+			}
+			bool HasMetadata() {
+				return metadata;
+			}
+			Metadata& GetMetadata() {
+				return meta;
+			}
+			void WriteMetadata();
+			void ReadMetadata();
+
+			// Optional table of function body lengths, inserted into the header after the
+			// bodies are written so each body can later be decoded on its own
+			void SetFunctionIndex(bool enable) {
+				function_index = enable;
+			}
+			bool HasFunctionIndex() {
+				return function_index;
+			}
+			void WriteFunctionIndex();
+			void ReadFunctionIndex();
+			// function_bits holds the start of every body followed by the end of the last
+			void InsertFunctionIndex(std::vector<uint64_t>& function_bits);
+			// Absolute start of every body followed by the end of the last
+			std::vector<uint64_t>& GetFunctionStarts() {
+				return function_starts;
+			}
+
+			// Preset dictionary that data and strings can refer back into
+			void SetDictionary(uint8_t version) {
+				dictionary_version = version;
+				dictionary         = PresetDictionary(version);
+			}
+			const Mni::Lz::Dictionary* GetDictionary() {
+				return dictionary;
+			}
+			void WriteDictionaryVersion();
+			// Returns false if the dictionary is newer than this version of mni
+			bool ReadDictionaryVersion();
+
+			std::vector<uint8_t>& GetBytes() {
+				return bytes;
 			}
 
 			Huffman& huffman;
 
 		private:
+			struct Column {
+				std::vector<uint8_t> bytes;
+				uint64_t current_bit { 0 };
+				uint64_t end_bit { 0 };
+				uint8_t leb_multiple { 5 };
+				// Number of LEBs written, indexed by required bits
+				std::array<uint64_t, 65> leb_bits {};
+			};
+
+			void SwitchColumn(WasmColumn column);
+			uint64_t TracedBit(uint8_t column);
+			void Trace(WasmItemType type);
+			void RecordLEB(uint8_t required_bits) {
+				if(columns_active) {
+					column_state[active_column].leb_bits[required_bits]++;
+				}
+			}
+
 			std::vector<uint8_t>& bytes;
+			// Stream currently written to, either bytes or a column while writing columns
+			std::vector<uint8_t>* stream;
 			uint64_t original_current_bit;
 			uint64_t current_bit;
 			uint64_t size { 0 };
 			uint8_t leb_multiple { 5 };
+
+			bool columns { false };
+			bool columns_active { false };
+			WasmColumn active_column { COLUMN_OPCODE };
+			std::array<Column, NUM_COLUMNS> column_state;
+			// Position in the main stream while columns are active
+			uint64_t main_current_bit { 0 };
+			uint8_t main_leb_multiple { 5 };
+
+			bool structured { false };
+
+			bool metadata { false };
+			Metadata meta;
+
+			bool function_index { false };
+			uint64_t function_index_bit { 0 };
+			std::vector<uint64_t> function_starts;
+
+			uint8_t dictionary_version { 0 };
+			const Mni::Lz::Dictionary* dictionary { nullptr };
+
+			uint64_t end_bit { UINT64_MAX };
+			uint64_t items_left { UINT64_MAX };
+			uint64_t data_left { UINT64_MAX };
+			bool failed { false };
+
+			std::vector<TracedItem>* trace { nullptr };
+			IO* traced_io { nullptr };
+			// Last traced item of every column, SIZE_MAX if there is none
+			std::array<size_t, NUM_COLUMNS> traced_last;
+			uint8_t traced_section { 0 };
+			uint32_t traced_function { NO_FUNCTION };
 		};
 
 		enum ParsingMode {
@@ -182,9 +808,64 @@ namespace Mni {
 			NONE, // Used while finding values for huffman encoding
 		};
 
-		uint64_t NormalToOptimized(
-			std::vector<uint8_t>& wasm_bytes, uint64_t current_bit, std::vector<uint8_t>& bytes);
+		struct OptimizedOptions {
+			// Split the stream into columns, see OptimizedIO::SetColumns
+			bool columns = false;
+			// Emit a function index, see OptimizedIO::SetFunctionIndex
+			// Not available together with columns
+			bool function_index = false;
+			// Count and encode function bodies on worker threads, output is identical
+			// Ignored together with columns
+			bool parallel = false;
+			// Emit a metadata block, see OptimizedIO::SetMetadata
+			bool metadata = false;
+			// Record every item written, see OptimizedIO::SetTrace
+			// Bodies are then encoded on one thread, the output is the same
+			std::vector<TracedItem>* trace = nullptr;
+			// Parse the module again in every pass instead of keeping its items, output is
+			// identical. Only useful to check the kept items against the streaming encoder
+			bool reparse = false;
+		};
+
+		uint64_t NormalToOptimized(std::vector<uint8_t>& wasm_bytes, uint64_t current_bit,
+			std::vector<uint8_t>& bytes, OptimizedOptions options = {});
+		// Returns 0 and leaves wasm_bytes empty if the stream is damaged
 		uint64_t OptimizedToNormal(
 			std::vector<uint8_t>& wasm_bytes, uint64_t current_bit, std::vector<uint8_t>& bytes);
+		// Bytes of an active data segment, copied into memory after instantiation
+		struct ActiveSegment {
+			uint32_t offset;
+			std::vector<uint8_t> bytes;
+		};
+		// Leaves active segments at a constant offset empty and moves their bytes into
+		// segments instead, so they are never copied into wasm_bytes
+		// Only when memory 0 is the one memory exported and there is no start function
+		uint64_t OptimizedToNormal(std::vector<uint8_t>& wasm_bytes, uint64_t current_bit,
+			std::vector<uint8_t>& bytes, std::vector<ActiveSegment>& segments);
+		// Check version and checksum without decoding, like for every frame of a scan
+		bool CheckPayload(std::vector<uint8_t>& bytes, uint64_t current_bit);
+		// Give a modified stream a matching checksum, so damage inside the payload reaches the
+		// decoder, like for fuzzing. Returns false if the version or length is unusable
+		bool SealPayload(std::vector<uint8_t>& bytes, uint64_t current_bit);
+		// Name of a traced item, the mnemonic of instructions and the item type otherwise
+		std::string_view ItemName(const TracedItem& item);
+		std::string_view ItemTypeName(WasmItemType type);
+		std::string_view SectionName(uint8_t id);
+		// Attribute the bits of a stream of total_bits to its traced items
+		BitStats CountBits(const std::vector<TracedItem>& trace, uint64_t total_bits);
+		// Read every item of normal or optimized webassembly with its position and bits
+		// Returns false if the stream can't be read
+		bool TraceItems(
+			std::vector<uint8_t>& bytes, bool optimized, std::vector<TracedItem>& trace);
+		// Read only the metadata block, returns false if the stream has none
+		bool ReadMetadata(std::vector<uint8_t>& bytes, uint64_t current_bit, Metadata& metadata);
+		// Names of function exports and optionally imports of normal webassembly, read by
+		// skipping over every other section. Returns false if the module is malformed
+		bool ScanExports(std::vector<uint8_t>& wasm_bytes, std::vector<std::string>& exports,
+			std::vector<std::string>* imports = nullptr);
+		// Decode a single function body (size, locals and code) into normal webassembly
+		// Requires a function index, returns false if the body does not match its index entry
+		bool DecodeFunction(std::vector<uint8_t>& bytes, uint64_t current_bit, uint32_t function,
+			std::vector<uint8_t>& body);
 	}
 }
\ No newline at end of file
@@ -8,7 +8,8 @@
 #include <core/SkFont.h>
 #include <core/SkSurface.h>
 #include <functional>
-#include <unordered_map>
+#include <mni/wasm/functions.hpp>
+#include <mni/wasm/parser.hpp>
 #include <vector>
 #include <wasm.h>
 #include <wasmtime.h>
@@ -31,31 +32,14 @@
 
 namespace Mni {
 	namespace Wasm {
-		// Reverse map at compile time
-		// https://benpm.github.io/blog/how-to-invert/reverse/transform-a-map-at-compile-time-in-c++/
-		template <typename Kout, typename Vout, typename Kin, typename Vin>
-		std::unordered_map<Kout, Vout> _transformMap(const std::unordered_map<Kin, Vin>& inMap,
-			const std::function<std::pair<Kout, Vout>(const std::pair<Kin, Vin>&)> mapfunc) {
-			std::unordered_map<Kout, Vout> outMap;
-			std::for_each(inMap.begin(), inMap.end(),
-				[&outMap, &mapfunc](const std::pair<Kin, Vin>& p) { outMap.insert(mapfunc(p)); });
-			return outMap;
-		}
-
-		static const std::unordered_map<int, std::string> DEFINED_FUNCTIONS MNI_INCLUDED_FUNCTIONS;
-		static const std::unordered_map<std::string, int> REVERSE_DEFINED_FUNCTIONS = _transformMap(
-			DEFINED_FUNCTIONS, std::function([](const std::pair<int, std::string>& p) {
-				return std::make_pair(p.second, p.first);
-			}));
-
-		struct Metadata {
-			std::string name;
-		};
-
 		class Runtime {
 		public:
 			Runtime(std::vector<uint8_t>& wasm_bytes)
 				: wasm_bytes(wasm_bytes) { }
+			// Segments left out of wasm_bytes by the decoder, written into memory directly
+			Runtime(std::vector<uint8_t>& wasm_bytes, std::vector<ActiveSegment> segments)
+				: wasm_bytes(wasm_bytes)
+				, segments(std::move(segments)) { }
 
 			bool PrepareWindowStartup();
 			// Must call this first
@@ -127,6 +111,7 @@ namespace Mni {
 			DECLARE_EXPORT(render)
 
 			std::vector<uint8_t>& wasm_bytes;
+			std::vector<ActiveSegment> segments;
 			int width { 512 };
 			int height { 512 };
 			bool render { true };
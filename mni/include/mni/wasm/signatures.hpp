@@ -0,0 +1,98 @@
+#pragma once
+
+#include <mni/wasm/functions.hpp>
+
+#include <array>
+#include <cstdint>
+
+namespace Mni {
+	namespace Wasm {
+		// Value types as read by HandleType
+		enum ValueType : int8_t {
+			VALUE_I32 = -0x01,
+			VALUE_I64 = -0x02,
+			VALUE_F32 = -0x03,
+			VALUE_F64 = -0x04,
+		};
+
+		struct Signature {
+			uint8_t num_params;
+			std::array<int8_t, 6> params;
+			uint8_t num_results;
+			int8_t result;
+		};
+
+		// Every distinct signature of the functions in imports.h, fixed by the ABI
+		// Published signatures must never change or be reordered, only appended
+		inline constexpr Signature KNOWN_SIGNATURES[] = {
+			// mni_clear_screen
+			{ 0, {}, 0, 0 },
+			// mni_set_line_width, mni_set_font, mni_set_font_size
+			{ 1, { VALUE_I32 }, 0, 0 },
+			// mni_set_bounds
+			{ 2, { VALUE_I32, VALUE_I32 }, 0, 0 },
+			// mni_draw_full_circle, mni_draw_text, mni_draw_text_fill
+			{ 3, { VALUE_I32, VALUE_I32, VALUE_I32 }, 0, 0 },
+			// mni_set_fill, mni_set_stroke, mni_draw_rect, mni_draw_full_oval
+			{ 4, { VALUE_I32, VALUE_I32, VALUE_I32, VALUE_I32 }, 0, 0 },
+			// mni_draw_rgb, mni_draw_rgba
+			{ 5, { VALUE_I32, VALUE_I32, VALUE_I32, VALUE_I32, VALUE_I32 }, 0, 0 },
+			// mni_draw_oval
+			{ 6, { VALUE_I32, VALUE_I32, VALUE_I32, VALUE_I32, VALUE_F32, VALUE_F32 }, 0, 0 },
+			// mni_draw_circle
+			{ 5, { VALUE_I32, VALUE_I32, VALUE_I32, VALUE_F32, VALUE_F32 }, 0, 0 },
+			// mni_prepare, mni_name, mni_has_rotation, mni_get_rotation, mni_is_pressed
+			{ 0, {}, 1, VALUE_I32 },
+			// mni_get_text_width
+			{ 1, { VALUE_I32 }, 1, VALUE_I32 },
+			// mni_load_png
+			{ 3, { VALUE_I32, VALUE_I32, VALUE_I32 }, 1, VALUE_I32 },
+			// mni_get_x_pressed, mni_get_y_pressed
+			{ 0, {}, 1, VALUE_F32 },
+			// mni_sinf, mni_cosf
+			{ 1, { VALUE_F32 }, 1, VALUE_F32 },
+			// mni_sin, mni_cos
+			{ 1, { VALUE_F64 }, 1, VALUE_F64 },
+			// mni_render
+			{ 1, { VALUE_I64 }, 1, VALUE_I32 },
+		};
+		inline constexpr uint8_t SIGNATURE_BITS = 4;
+		inline constexpr uint8_t NO_SIGNATURE   = 0xFF;
+		static_assert(std::size(KNOWN_SIGNATURES) <= (1 << SIGNATURE_BITS));
+
+		// Index into KNOWN_SIGNATURES for every id in DEFINED_FUNCTIONS
+		inline constexpr uint8_t FUNCTION_SIGNATURES[] = {
+			8,  // mni_prepare
+			14, // mni_render
+			8,  // mni_name
+			2,  // mni_set_bounds
+			4,  // mni_set_fill
+			4,  // mni_set_stroke
+			1,  // mni_set_line_width
+			4,  // mni_draw_rect
+			6,  // mni_draw_oval
+			7,  // mni_draw_circle
+			4,  // mni_draw_full_oval
+			3,  // mni_draw_full_circle
+			0,  // mni_clear_screen
+			1,  // mni_set_font
+			1,  // mni_set_font_size
+			9,  // mni_get_text_width
+			3,  // mni_draw_text
+			3,  // mni_draw_text_fill
+			5,  // mni_draw_rgb
+			5,  // mni_draw_rgba
+			10, // mni_load_png
+			8,  // mni_has_rotation
+			8,  // mni_get_rotation
+			8,  // mni_is_pressed
+			11, // mni_get_x_pressed
+			11, // mni_get_y_pressed
+			12, // mni_sinf
+			12, // mni_cosf
+			13, // mni_sin
+			13, // mni_cos
+		};
+		static_assert(std::size(FUNCTION_SIGNATURES) == DEFINED_FUNCTIONS.names.size());
+	}
+}
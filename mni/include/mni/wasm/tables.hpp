@@ -0,0 +1,271 @@
+#pragma once
+
+#include <mni/tree.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+
+namespace Mni {
+	namespace Wasm {
+		// Huffman table built at compile time from fixed weights, indexed by value
+		// Published tables must never change, codes using them are decoded with the same codes
+		template <typename T, size_t N> struct BuiltinTable {
+			std::array<uint8_t, N> lengths {};
+			std::array<uint64_t, N> codes {};
+			// Decoding tree laid out the same way ReadHuffmanHeader builds it
+			std::array<Tree::FlatNode<T>, 2 * N - 1> nodes {};
+
+			std::unordered_map<T, Tree::NodeRepresentation> RepMap() const {
+				std::unordered_map<T, Tree::NodeRepresentation> rep_map;
+				for(size_t value = 0; value < N; value++) {
+					rep_map[value] = Tree::NodeRepresentation { codes[value], lengths[value] };
+				}
+				return rep_map;
+			}
+		};
+
+		template <typename T, size_t N>
+		constexpr BuiltinTable<T, N> MakeBuiltinTable(std::array<uint32_t, N> weights) {
+			BuiltinTable<T, N> table;
+
+			// Code lengths by repeatedly joining the two lightest nodes, the last node is the root
+			constexpr size_t NONE = 2 * N;
+			std::array<uint64_t, 2 * N - 1> weight {};
+			std::array<size_t, 2 * N - 1> parent {};
+			std::array<bool, 2 * N - 1> joined {};
+			for(size_t value = 0; value < N; value++) {
+				weight[value] = weights[value];
+			}
+			for(size_t next = N; next < 2 * N - 1; next++) {
+				size_t first = NONE, second = NONE;
+				for(size_t i = 0; i < next; i++) {
+					if(joined[i]) {
+						continue;
+					}
+					if(first == NONE || weight[i] < weight[first]) {
+						second = first;
+						first  = i;
+					} else if(second == NONE || weight[i] < weight[second]) {
+						second = i;
+					}
+				}
+				joined[first] = joined[second] = true;
+				parent[first] = parent[second] = next;
+				weight[next]                   = weight[first] + weight[second];
+			}
+
+			uint8_t max_length = 0;
+			for(size_t value = 0; value < N; value++) {
+				for(size_t node = value; node != 2 * N - 2; node = parent[node]) {
+					table.lengths[value]++;
+				}
+				max_length = std::max(max_length, table.lengths[value]);
+			}
+
+			// Canonical codes, shorter codes first and equal lengths ordered by value
+			uint64_t code = 0;
+			for(uint8_t length = 1; length <= max_length; length++) {
+				for(size_t value = 0; value < N; value++) {
+					if(table.lengths[value] == length) {
+						table.codes[value] = code++;
+					}
+				}
+				code <<= 1;
+			}
+
+			uint32_t num_nodes = 1;
+			for(size_t value = 0; value < N; value++) {
+				uint32_t node = 0;
+				for(int8_t bit = table.lengths[value] - 1; bit > -1; bit--) {
+					bool direction = table.codes[value] & (1ULL << bit);
+					if(!table.nodes[node].children[direction]) {
+						table.nodes[node].children[direction] = num_nodes++;
+					}
+					node = table.nodes[node].children[direction];
+				}
+				table.nodes[node].data = value;
+			}
+
+			return table;
+		}
+
+		// Weights per 10000 opcodes in emcc -Oz output, every other byte gets 1
+		constexpr std::array<uint32_t, 256> InstructionWeights() {
+			std::array<uint32_t, 256> weights {};
+			weights.fill(1);
+			constexpr std::pair<uint8_t, uint32_t> common[] = {
+				{ 0x20, 2600 }, // local.get
+				{ 0x41, 1100 }, // i32.const
+				{ 0x21, 650 },  // local.set
+				{ 0x6a, 520 },  // i32.add
+				{ 0x0b, 520 },  // end
+				{ 0x10, 430 },  // call
+				{ 0x28, 400 },  // i32.load
+				{ 0x22, 330 },  // local.tee
+				{ 0x36, 300 },  // i32.store
+				{ 0x0d, 250 },  // br_if
+				{ 0x02, 220 },  // block
+				{ 0x71, 150 },  // i32.and
+				{ 0x6b, 140 },  // i32.sub
+				{ 0x45, 130 },  // i32.eqz
+				{ 0x23, 120 },  // global.get
+				{ 0x2d, 120 },  // i32.load8_u
+				{ 0x0c, 110 },  // br
+				{ 0x24, 100 },  // global.set
+				{ 0x46, 90 },   // i32.eq
+				{ 0x1b, 90 },   // select
+				{ 0x3a, 90 },   // i32.store8
+				{ 0x47, 80 },   // i32.ne
+				{ 0x04, 80 },   // if
+				{ 0x74, 80 },   // i32.shl
+				{ 0x1a, 70 },   // drop
+				{ 0x76, 70 },   // i32.shr_u
+				{ 0x72, 70 },   // i32.or
+				{ 0x49, 70 },   // i32.lt_u
+				{ 0x03, 60 },   // loop
+				{ 0x0f, 60 },   // return
+				{ 0x6c, 60 },   // i32.mul
+				{ 0x48, 60 },   // i32.lt_s
+				{ 0x43, 60 },   // f32.const
+				{ 0x4b, 50 },   // i32.gt_u
+				{ 0x4a, 50 },   // i32.gt_s
+				{ 0x73, 40 },   // i32.xor
+				{ 0x2a, 40 },   // f32.load
+				{ 0x38, 40 },   // f32.store
+				{ 0x94, 40 },   // f32.mul
+				{ 0x05, 30 },   // else
+				{ 0x75, 30 },   // i32.shr_s
+				{ 0x4d, 30 },   // i32.le_u
+				{ 0x4c, 30 },   // i32.le_s
+				{ 0x4f, 30 },   // i32.ge_u
+				{ 0x4e, 30 },   // i32.ge_s
+				{ 0x2f, 30 },   // i32.load16_u
+				{ 0x3b, 30 },   // i32.store16
+				{ 0x11, 30 },   // call_indirect
+				{ 0x42, 30 },   // i64.const
+				{ 0x92, 30 },   // f32.add
+				{ 0x93, 30 },   // f32.sub
+				{ 0xb2, 30 },   // f32.convert_i32_s
+				{ 0xa8, 30 },   // i32.trunc_f32_s
+				{ 0x2c, 20 },   // i32.load8_s
+				{ 0x44, 20 },   // f64.const
+				{ 0x29, 20 },   // i64.load
+				{ 0x37, 20 },   // i64.store
+				{ 0x95, 20 },   // f32.div
+				{ 0x0e, 15 },   // br_table
+				{ 0x00, 15 },   // unreachable
+				{ 0xa7, 15 },   // i32.wrap_i64
+				{ 0xad, 15 },   // i64.extend_i32_u
+				{ 0x70, 15 },   // i32.rem_u
+				{ 0x6e, 15 },   // i32.div_u
+				{ 0x2e, 10 },   // i32.load16_s
+				{ 0x2b, 10 },   // f64.load
+				{ 0x39, 10 },   // f64.store
+				{ 0x5d, 10 },   // f32.lt
+				{ 0x5e, 10 },   // f32.gt
+				{ 0xa0, 10 },   // f64.add
+				{ 0xa2, 10 },   // f64.mul
+				{ 0xac, 10 },   // i64.extend_i32_s
+				{ 0x7c, 10 },   // i64.add
+				{ 0x7e, 10 },   // i64.mul
+				{ 0x6d, 10 },   // i32.div_s
+				{ 0x6f, 10 },   // i32.rem_s
+				{ 0xfc, 10 },   // Misc prefix, bulk memory
+			};
+			for(auto [code, weight] : common) {
+				weights[code] = weight;
+			}
+			return weights;
+		}
+
+		// Instructions inside a block, where end closes the block instead of the function
+		constexpr std::array<uint32_t, 256> BlockOpcodeWeights() {
+			std::array<uint32_t, 256> weights = InstructionWeights();
+			weights[0x0b] = 900; // end
+			return weights;
+		}
+
+		// Lower locals are used more, parameters come first
+		constexpr std::array<uint32_t, 64> LocalWeights() {
+			std::array<uint32_t, 64> weights {};
+			for(uint32_t local = 0; local < 64; local++) {
+				weights[local] = 4096 / (local + 2);
+			}
+			return weights;
+		}
+
+		// Most breaks target the innermost blocks
+		constexpr std::array<uint32_t, 32> BreakWeights() {
+			std::array<uint32_t, 32> weights {};
+			for(uint32_t depth = 0; depth < 32; depth++) {
+				weights[depth] = depth < 12 ? 4096 >> depth : 1;
+			}
+			return weights;
+		}
+
+		// Natural alignment of i32 accesses dominates, then bytes and halves
+		constexpr std::array<uint32_t, 8> AlignWeights() {
+			return { 300, 100, 500, 80, 5, 1, 1, 1 };
+		}
+
+		// Strings and data are mostly lowercase names, with padding and terminators
+		constexpr std::array<uint32_t, 256> DataWeights() {
+			std::array<uint32_t, 256> weights {};
+			weights.fill(2);
+			constexpr char lowercase[] = "etaoinsrhldcumfpgwybvkxjqz";
+			for(uint32_t i = 0; i < 26; i++) {
+				weights[(uint8_t)lowercase[i]] = 400 - i * 14;
+			}
+			for(uint32_t letter = 'A'; letter <= 'Z'; letter++) {
+				weights[letter] = 20;
+			}
+			for(uint32_t digit = '0'; digit <= '9'; digit++) {
+				weights[digit] = 30;
+			}
+			weights[0]    = 300;
+			weights['_']  = 250;
+			weights[' ']  = 150;
+			weights['.']  = 40;
+			weights['%']  = 20;
+			weights['\n'] = 20;
+			weights[0xff] = 20;
+			return weights;
+		}
+
+		// Immediates an opcode almost always has, a correct guess is written as a single bit
+		// and anything else is escaped to the usual coding
+		struct ImmediatePrediction {
+			// Natural alignment with no offset
+			bool memory_op = false;
+			uint8_t align  = 0;
+			// No block result
+			bool type = false;
+		};
+
+		constexpr std::array<ImmediatePrediction, 256> ImmediatePredictions() {
+			std::array<ImmediatePrediction, 256> predictions {};
+			predictions[0x02].type = true; // block
+			predictions[0x03].type = true; // loop
+			predictions[0x04].type = true; // if
+			// Log2 of the access size from i32.load to i64.store32
+			constexpr uint8_t natural[] = { 2, 3, 2, 3, 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 2, 3, 2, 3,
+				0, 1, 0, 1, 2 };
+			for(uint8_t i = 0; i < sizeof(natural); i++) {
+				predictions[0x28 + i].memory_op = true;
+				predictions[0x28 + i].align     = natural[i];
+			}
+			return predictions;
+		}
+
+		inline constexpr auto IMMEDIATE_PREDICTIONS = ImmediatePredictions();
+
+		inline constexpr auto INSTRUCTION_TABLE  = MakeBuiltinTable<uint8_t>(InstructionWeights());
+		inline constexpr auto BLOCK_OPCODE_TABLE = MakeBuiltinTable<uint8_t>(BlockOpcodeWeights());
+		inline constexpr auto LOCAL_TABLE        = MakeBuiltinTable<uint32_t>(LocalWeights());
+		inline constexpr auto BREAK_TABLE        = MakeBuiltinTable<uint32_t>(BreakWeights());
+		inline constexpr auto ALIGN_TABLE        = MakeBuiltinTable<uint32_t>(AlignWeights());
+		inline constexpr auto DATA_TABLE         = MakeBuiltinTable<uint8_t>(DataWeights());
+	}
+}
@@ -0,0 +1,193 @@
+#include <mni.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+
+namespace Mni {
+	namespace Cache {
+		// Bumped whenever the files of an entry or what decides them change
+		static constexpr uint8_t CACHE_VERSION = 1;
+
+		// FNV-1a, stable across platforms and builds unlike std::hash
+		static uint64_t Hash(uint64_t hash, const void* data, size_t size) {
+			auto bytes = (const uint8_t*)data;
+			for(size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 0x100000001B3ULL;
+			}
+			return hash;
+		}
+
+		static bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& bytes) {
+			std::ifstream file(path, std::ios::binary);
+			if(!file) {
+				return false;
+			}
+			bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			return !file.bad();
+		}
+
+		static bool WriteFile(const std::filesystem::path& path, std::span<const uint8_t> bytes) {
+			std::ofstream file(path, std::ios::binary);
+			file.write((const char*)bytes.data(), bytes.size());
+			file.close();
+			return !file.fail();
+		}
+
+		// Remove the least recently used entries until the cache is at most max_bytes
+		static void Evict(const std::filesystem::path& dir, uint64_t max_bytes) {
+			struct Stored {
+				std::filesystem::path path;
+				std::filesystem::file_time_type time;
+				uint64_t bytes;
+			};
+			std::vector<Stored> stored;
+			uint64_t total_bytes = 0;
+
+			std::error_code error;
+			for(auto it = std::filesystem::directory_iterator(dir, error);
+				!error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+				// Entries still being written by Store start with a dot
+				if(!it->is_directory(error) || it->path().filename().string().starts_with(".")) {
+					continue;
+				}
+
+				uint64_t bytes = 0;
+				for(auto file = std::filesystem::directory_iterator(it->path(), error);
+					!error && file != std::filesystem::directory_iterator();
+					file.increment(error)) {
+					uint64_t size = file->file_size(error);
+					bytes += error ? 0 : size;
+				}
+				stored.push_back({ it->path(), it->last_write_time(error), bytes });
+				total_bytes += bytes;
+				error.clear();
+			}
+
+			std::sort(stored.begin(), stored.end(),
+				[](const Stored& a, const Stored& b) { return a.time < b.time; });
+			for(auto& entry : stored) {
+				if(total_bytes <= max_bytes) {
+					break;
+				}
+				std::filesystem::remove_all(entry.path, error);
+				total_bytes -= entry.bytes;
+			}
+		}
+
+		std::filesystem::path DefaultDirectory() {
+			auto Get = [](const char* name) {
+				const char* value = std::getenv(name);
+				return value && *value ? value : nullptr;
+			};
+
+			if(auto dir = Get("MNI_CACHE_DIR")) {
+				return dir;
+			}
+			if(auto dir = Get("XDG_CACHE_HOME")) {
+				return std::filesystem::path(dir) / "mni";
+			}
+			if(auto dir = Get("LOCALAPPDATA")) {
+				return std::filesystem::path(dir) / "mni";
+			}
+			if(auto dir = Get("HOME")) {
+				return std::filesystem::path(dir) / ".cache" / "mni";
+			}
+			std::error_code error;
+			return std::filesystem::temp_directory_path(error) / "mni";
+		}
+
+		std::string Key(std::span<const uint8_t> wasm_bytes, std::string_view options) {
+			uint8_t versions[]
+				= { CACHE_VERSION, Wasm::FORMAT_VERSION, Wasm::DICTIONARY_VERSION };
+			uint64_t options_size = options.size();
+
+			uint64_t hash = 0xCBF29CE484222325ULL;
+			hash          = Hash(hash, versions, sizeof(versions));
+			hash          = Hash(hash, &options_size, sizeof(options_size));
+			hash          = Hash(hash, options.data(), options.size());
+			hash          = Hash(hash, wasm_bytes.data(), wasm_bytes.size());
+
+			char key[40];
+			std::snprintf(key, sizeof(key), "%016llx-%llx", (unsigned long long)hash,
+				(unsigned long long)wasm_bytes.size());
+			return key;
+		}
+
+		bool Load(const std::filesystem::path& dir, const std::string& key, Entry& entry) {
+			auto path = dir / key;
+			std::vector<uint8_t> info;
+			if(!ReadFile(path / "info", info) || !ReadFile(path / "wasm", entry.wasm)
+				|| !ReadFile(path / "owasm", entry.optimized)) {
+				return false;
+			}
+
+			// Size in bits, then one export per line
+			std::istringstream lines(std::string(info.begin(), info.end()));
+			if(!(lines >> entry.size) || (entry.size + 7) / 8 != entry.optimized.size()) {
+				return false;
+			}
+			lines.ignore(1);
+			entry.exports.clear();
+			for(std::string name; std::getline(lines, name);) {
+				entry.exports.push_back(name);
+			}
+
+			entry.qr_png.clear();
+			ReadFile(path / "qr.png", entry.qr_png);
+
+			// Recently used entries are evicted last
+			std::error_code error;
+			auto now = std::filesystem::file_time_type::clock::now();
+			std::filesystem::last_write_time(path, now, error);
+			return true;
+		}
+
+		bool Store(const std::filesystem::path& dir, const std::string& key, const Entry& entry,
+			uint64_t max_bytes) {
+			std::error_code error;
+			std::filesystem::create_directories(dir, error);
+
+			// Written next to the entry and renamed, so readers never see part of an entry
+			std::random_device random;
+			auto temp = dir / ("." + key + "-" + std::to_string(random()));
+			if(!std::filesystem::create_directory(temp, error)) {
+				return false;
+			}
+
+			std::string info = std::to_string(entry.size) + "\n";
+			for(auto& name : entry.exports) {
+				info += name + "\n";
+			}
+			bool written = WriteFile(temp / "info", { (const uint8_t*)info.data(), info.size() })
+						   && WriteFile(temp / "wasm", entry.wasm)
+						   && WriteFile(temp / "owasm", entry.optimized)
+						   && (entry.qr_png.empty() || WriteFile(temp / "qr.png", entry.qr_png));
+
+			auto path = dir / key;
+			if(written) {
+				// Entries stored meanwhile or without a QR code are replaced
+				std::filesystem::remove_all(path, error);
+				std::filesystem::rename(temp, path, error);
+				written = !error;
+				// Another process stored the same entry in between, which is as good
+				if(!written && std::filesystem::exists(path / "info", error)) {
+					std::filesystem::remove_all(temp, error);
+					written = true;
+				}
+			}
+			if(!written) {
+				std::filesystem::remove_all(temp, error);
+				return false;
+			}
+
+			Evict(dir, max_bytes);
+			return true;
+		}
+	}
+}
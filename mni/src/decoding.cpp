@@ -1,14 +1,41 @@
 #include <mni.hpp>
 
+#include <array>
 #include <iostream>
 
 namespace Mni {
 	namespace Decoding {
 		uint64_t Read1Bit(bool* bit_out, uint64_t current_bit, std::vector<uint8_t>& bytes) {
-			*bit_out = bytes[current_bit >> 3] << (current_bit % 8) & 0b10000000;
+			uint64_t byte = current_bit >> 3;
+			*bit_out      = byte < bytes.size() && bytes[byte] << (current_bit % 8) & 0b10000000;
 			return current_bit + 1;
 		}
 
+		static constexpr std::array<uint16_t, 256> CRC16_TABLE = [] {
+			std::array<uint16_t, 256> table {};
+			for(int i = 0; i < 256; i++) {
+				uint16_t crc = i << 8;
+				for(int bit = 0; bit < 8; bit++) {
+					crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+				}
+				table[i] = crc;
+			}
+			return table;
+		}();
+
+		uint16_t Crc16(uint64_t current_bit, uint64_t size, std::vector<uint8_t>& bytes) {
+			uint16_t crc = 0xFFFF;
+			uint64_t end = current_bit + size;
+			while(current_bit < end) {
+				uint8_t bits = std::min<uint64_t>(8, end - current_bit);
+				uint8_t byte;
+				current_bit = ReadNumUnsigned(&byte, bits, current_bit, bytes);
+				byte <<= 8 - bits;
+				crc = (crc << 8) ^ CRC16_TABLE[(crc >> 8) ^ byte];
+			}
+			return crc;
+		}
+
 		uint64_t ReadFloat(float* num_out, uint8_t removed_mantissa_bits, uint64_t current_bit,
 			std::vector<uint8_t>& bytes) {
 			constexpr uint8_t float_mantissa_bits = 23;
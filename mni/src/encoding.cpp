@@ -2,6 +2,7 @@
 #include <mni/tree.hpp>
 
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <unordered_map>
 
@@ -67,22 +68,11 @@ namespace Mni {
 			uint64_t start, uint64_t end, uint64_t new_start, std::vector<uint8_t>& bytes) {
 			auto size = end - start;
 
-			if(new_start > start) {
-				if(bytes.size() <= ((new_start + size) >> 3)) {
-					bytes.resize(((new_start + size) >> 3) + 1);
-				}
-
-				for(uint64_t i = size; i > 0; i--) {
-					bool bit;
-					Decoding::Read1Bit(&bit, start + i - 1, bytes);
-					Write1Bit(bit, new_start + i - 1, bytes);
-				}
-			} else if(new_start < start) {
-				for(uint64_t i = 0; i < size; i++) {
-					bool bit;
-					Decoding::Read1Bit(&bit, start + i, bytes);
-					Write1Bit(bit, new_start + i, bytes);
-				}
+			if(new_start != start) {
+				// Ranges can overlap, copy through a temporary buffer
+				std::vector<uint8_t> temp;
+				CopyBits(start, end, 0, bytes, temp);
+				CopyBits(0, size, new_start, temp, bytes);
 			}
 
 			return new_start + size;
@@ -91,10 +81,50 @@ namespace Mni {
 		uint64_t CopyBits(uint64_t start, uint64_t end, uint64_t new_start,
 			std::vector<uint8_t>& bytes_src, std::vector<uint8_t>& bytes_dest) {
 			auto size = end - start;
-			for(uint64_t i = 0; i < size; i++) {
-				bool bit;
-				Decoding::Read1Bit(&bit, start + i, bytes_src);
-				Write1Bit(bit, new_start + i, bytes_dest);
+			if(size == 0) {
+				return new_start;
+			}
+
+			if(bytes_dest.size() <= ((new_start + size - 1) >> 3)) {
+				bytes_dest.resize(((new_start + size - 1) >> 3) + 1);
+			}
+
+			return CopyBits(start, end, new_start, bytes_src.data(), bytes_dest.data());
+		}
+
+		uint64_t CopyBits(uint64_t start, uint64_t end, uint64_t new_start, const uint8_t* src,
+			uint8_t* dest) {
+			auto size     = end - start;
+			auto CopyBit = [&](uint64_t i) {
+				uint64_t src_bit  = start + i;
+				uint64_t dest_bit = new_start + i;
+				bool bit          = src[src_bit >> 3] & (0b10000000 >> (src_bit % 8));
+				dest[dest_bit >> 3]
+					^= (-!!bit ^ dest[dest_bit >> 3]) & (0b10000000 >> (dest_bit % 8));
+			};
+
+			// Copy single bits until destination is byte aligned
+			uint64_t i = 0;
+			for(; i < size && ((new_start + i) & 7); i++) {
+				CopyBit(i);
+			}
+
+			// Then whole destination bytes, taken from at most two source bytes
+			uint8_t shift     = (start + i) & 7;
+			uint64_t num_bytes = (size - i) >> 3;
+			if(shift == 0) {
+				std::memcpy(dest + ((new_start + i) >> 3), src + ((start + i) >> 3), num_bytes);
+				i += num_bytes * 8;
+			} else {
+				for(; size - i >= 8; i += 8) {
+					uint64_t src_byte = (start + i) >> 3;
+					uint16_t window   = (src[src_byte] << 8) | src[src_byte + 1];
+					dest[(new_start + i) >> 3] = window >> (8 - shift);
+				}
+			}
+
+			for(; i < size; i++) {
+				CopyBit(i);
 			}
 
 			return new_start + size;
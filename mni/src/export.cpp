@@ -23,13 +23,30 @@
 
 namespace Mni {
 	namespace Export {
+		// Bytes of every version in byte mode, at the low error correction used below
+		static constexpr uint16_t QR_CAPACITY[] = { 17, 32, 53, 78, 106, 134, 154, 192, 230, 271,
+			321, 367, 425, 458, 520, 586, 644, 718, 792, 858, 929, 1003, 1091, 1171, 1273, 1367,
+			1465, 1528, 1628, 1732, 1840, 1952, 2068, 2188, 2303, 2431, 2563, 2699, 2809, 2953 };
+
+		uint8_t QRVersion(uint64_t size) {
+			uint64_t num_bytes = (size + 7) / 8;
+			for(uint8_t version = 1; version <= std::size(QR_CAPACITY); version++) {
+				if(num_bytes <= QR_CAPACITY[version - 1]) {
+					return version;
+				}
+			}
+			return 0;
+		}
+
 		bool GenerateQRCode(
 			uint64_t size, std::vector<uint8_t>& bytes, int width, int height, std::string path) {
 			constexpr int pixel_size    = 10;
 			constexpr int margin_size   = 3;
 			constexpr int bottom_margin = 0; // 200
 
-			if(bytes.size() > 2953)
+			// Only the bytes holding the stream, the header has its exact length
+			uint64_t num_bytes = (size + 7) / 8;
+			if(QRVersion(size) == 0 || num_bytes > bytes.size())
 				return false;
 
 			ZXing::QRCode::Writer writer;
@@ -37,7 +54,7 @@ namespace Mni {
 			writer.setEncoding(ZXing::CharacterSet::BINARY);
 			writer.setErrorCorrectionLevel(ZXing::QRCode::ErrorCorrectionLevel::Low);
 
-			std::wstring output(bytes.begin(), bytes.end());
+			std::wstring output(bytes.begin(), bytes.begin() + num_bytes);
 			auto matrix = writer.encode(output, 1, 1);
 
 			if(matrix.empty())
@@ -24,7 +24,7 @@
 
 namespace Mni {
 	namespace Import {
-		void ScanQRCode(std::vector<uint8_t>& bytes, std::string path) {
+		bool ScanQRCode(std::vector<uint8_t>& bytes, std::string path) {
 			auto gen = SkImageGenerator::MakeFromEncoded(SkData::MakeFromFileName(path.c_str()));
 
 			SkBitmap bitmap;
@@ -42,11 +42,18 @@ namespace Mni {
 					qrHints);
 
 			if(!result.isValid()) {
-				// Oh no
+				return false;
 			}
 
+			// Reject corrupt reads before anything is decoded
 			auto qr_bytes = result.bytes();
-			std::copy(qr_bytes.begin(), qr_bytes.end(), std::back_inserter(bytes));
+			std::vector<uint8_t> payload(qr_bytes.begin(), qr_bytes.end());
+			if(!Mni::Wasm::CheckPayload(payload, 0)) {
+				return false;
+			}
+
+			std::copy(payload.begin(), payload.end(), std::back_inserter(bytes));
+			return true;
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include <mni/lz.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace Mni {
+	namespace Lz {
+		static constexpr uint8_t MAX_HASH_BITS = 14;
+		// Small tables for short strings
+		static constexpr uint8_t MIN_HASH_BITS = 6;
+
+		static uint32_t Hash(const uint8_t* data, uint8_t hash_bits) {
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return (value * 2654435761U) >> (32 - hash_bits);
+		}
+
+		Dictionary::Dictionary(std::span<const uint8_t> bytes)
+			: bytes(bytes)
+			, head(1 << MAX_HASH_BITS, -1)
+			, prev(bytes.size(), -1) {
+			for(size_t pos = 0; pos + MIN_MATCH <= bytes.size(); pos++) {
+				uint32_t hash = Hash(&bytes[pos], MAX_HASH_BITS);
+				prev[pos]     = head[hash];
+				head[hash]    = pos;
+			}
+		}
+
+		std::vector<Token> Parse(std::span<const uint8_t> data, const Dictionary* dictionary) {
+			std::vector<Token> tokens;
+			size_t size = data.size();
+
+			// Positions in the dictionary are negative, counting back from the data
+			int64_t dictionary_size = dictionary ? dictionary->bytes.size() : 0;
+			auto At = [&](int64_t pos) {
+				return pos < 0 ? dictionary->bytes[dictionary_size + pos] : data[pos];
+			};
+
+			// Most recent position for every hash, chained through prev
+			uint8_t hash_bits
+				= std::clamp<uint8_t>(std::bit_width(size), MIN_HASH_BITS, MAX_HASH_BITS);
+			std::vector<int64_t> head(1 << hash_bits, -1);
+			std::vector<int64_t> prev(size, -1);
+			auto Insert = [&](size_t pos) {
+				if(pos + MIN_MATCH <= size) {
+					uint32_t hash = Hash(&data[pos], hash_bits);
+					prev[pos]     = head[hash];
+					head[hash]    = pos;
+				}
+			};
+
+			size_t i = 0;
+			while(i < size) {
+				uint32_t zeros = 0;
+				while(i + zeros < size && data[i + zeros] == 0) {
+					zeros++;
+				}
+
+				uint32_t best_length   = 0;
+				uint32_t best_distance = 0;
+				auto Check             = [&](int64_t candidate) {
+					uint32_t length = 0;
+					while(i + length < size && At(candidate + length) == data[i + length]) {
+						length++;
+					}
+					if(length > best_length) {
+						best_length   = length;
+						best_distance = i - candidate;
+					}
+				};
+
+				if(i + MIN_MATCH <= size) {
+					int64_t candidate = head[Hash(&data[i], hash_bits)];
+					for(uint32_t chain = 0; candidate != -1 && chain < MAX_CHAIN; chain++) {
+						Check(candidate);
+						candidate = prev[candidate];
+					}
+
+					if(dictionary) {
+						candidate = dictionary->head[Hash(&data[i], MAX_HASH_BITS)];
+						for(uint32_t chain = 0; candidate != -1 && chain < MAX_CHAIN; chain++) {
+							Check(candidate - dictionary_size);
+							candidate = dictionary->prev[candidate];
+						}
+					}
+				}
+
+				size_t advance;
+				if(zeros >= MIN_ZERO_RUN && zeros >= best_length) {
+					tokens.push_back(Token { ZERO_RUN, 0, zeros, 0 });
+					advance = zeros;
+				} else if(best_length >= MIN_MATCH) {
+					tokens.push_back(Token { MATCH, 0, best_length, best_distance });
+					advance = best_length;
+				} else {
+					tokens.push_back(Token { LITERAL, data[i], 1, 0 });
+					advance = 1;
+				}
+
+				for(size_t end = i + advance; i < end; i++) {
+					Insert(i);
+				}
+			}
+
+			return tokens;
+		}
+
+		bool AppendMatch(std::vector<uint8_t>& out, size_t distance, size_t length,
+			std::span<const uint8_t> dictionary) {
+			if(distance == 0 || distance > out.size() + dictionary.size()) {
+				return false;
+			}
+
+			if(distance > out.size()) {
+				// Starts in the dictionary, then continues at the start of out
+				size_t start           = dictionary.size() - (distance - out.size());
+				size_t from_dictionary = std::min(length, dictionary.size() - start);
+				out.insert(out.end(), dictionary.begin() + start,
+					dictionary.begin() + start + from_dictionary);
+				length -= from_dictionary;
+				if(length == 0) {
+					return true;
+				}
+			}
+
+			size_t start = out.size() - distance;
+			size_t pos   = out.size();
+			out.resize(pos + length);
+
+			// Copy in blocks that never overlap, each twice the size of the last when the
+			// match repeats its own output
+			size_t copied = 0;
+			while(copied < length) {
+				size_t chunk = std::min(length - copied, pos + copied - start);
+				std::memcpy(&out[pos + copied], &out[start], chunk);
+				copied += chunk;
+			}
+
+			return true;
+		}
+	}
+}
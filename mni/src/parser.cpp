@@ -0,0 +1,23 @@
+#include <mni.hpp>
+
+#include <cstring>
+#include <string>
+
+namespace Mni {
+	Parser::Parser(uint8_t* buf, size_t size)
+		: bytes(buf, buf + size) {
+		constexpr uint8_t magic[] = { 0x00, 0x61, 0x73, 0x6d };
+		optimized = size < sizeof(magic) || std::memcmp(buf, magic, sizeof(magic)) != 0;
+		valid     = Wasm::TraceItems(bytes, optimized, trace);
+	}
+
+	std::vector<std::string> Parser::GetInstructionStrings() {
+		std::vector<std::string> instructions;
+		instructions.reserve(trace.size());
+		for(auto item : *this) {
+			instructions.push_back(std::to_string(item.bit) + " " + std::string(item.name) + " ("
+								   + std::to_string(item.bits) + " bits)");
+		}
+		return instructions;
+	}
+}
@@ -1,16 +1,22 @@
 #include <mni.hpp>
+#include <mni/parallel.hpp>
 #include <mni/wasm/parser.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <ir/table-utils.h>
+#include <ir/utils.h>
 #include <m3_env.h>
 #include <pass.h>
 #include <tools/optimization-options.h>
@@ -60,10 +66,96 @@ private:
 	std::unordered_set<wasm::Function*> reachable;
 };
 
+// Counts global.get and global.set of every global
+class GlobalUseCounter : public wasm::PostWalker<GlobalUseCounter> {
+public:
+	GlobalUseCounter(std::unordered_map<wasm::Name, uint64_t>& counts)
+		: counts(counts) { }
+
+	void visitGlobalGet(wasm::GlobalGet* curr) {
+		counts[curr->name]++;
+	}
+
+	void visitGlobalSet(wasm::GlobalSet* curr) {
+		counts[curr->name]++;
+	}
+
+private:
+	std::unordered_map<wasm::Name, uint64_t>& counts;
+};
+
 namespace Mni {
 	namespace Wasm {
+		// Give the most used globals the smallest indices
+		static void ReorderGlobals(wasm::Module& wasm) {
+			// Defined globals may only refer to earlier ones, keep them in place then
+			std::unordered_map<wasm::Name, uint64_t> init_uses;
+			for(auto& global : wasm.globals) {
+				if(!global->imported() && global->init) {
+					GlobalUseCounter(init_uses).walk(global->init);
+				}
+			}
+			for(auto& [name, count] : init_uses) {
+				if(!wasm.getGlobal(name)->imported()) {
+					return;
+				}
+			}
+
+			std::unordered_map<wasm::Name, uint64_t> uses;
+			GlobalUseCounter(uses).walkModule(&wasm);
+			// Imported globals are numbered first by the writer regardless of this order
+			std::stable_sort(wasm.globals.begin(), wasm.globals.end(),
+				[&](auto& a, auto& b) { return uses[a->name] > uses[b->name]; });
+			wasm.updateMaps();
+		}
+
+		// Cheap stand-in for the binary size between rounds, in expressions and declarations
+		static uint64_t EstimateSize(wasm::Module& wasm) {
+			uint64_t size = wasm.functions.size() + wasm.globals.size();
+			for(auto& func : wasm.functions) {
+				if(!func->imported()) {
+					size += wasm::Measurer::measure(func->body) + func->vars.size();
+				}
+			}
+			return size;
+		}
+
+		static std::unordered_map<wasm::Name, size_t> HashBodies(wasm::Module& wasm) {
+			std::unordered_map<wasm::Name, size_t> hashes;
+			for(auto& func : wasm.functions) {
+				if(!func->imported()) {
+					hashes[func->name] = wasm::ExpressionAnalyzer::hash(func->body);
+				}
+			}
+			return hashes;
+		}
+
+		// Pass settings tried by the search, the first is used otherwise
+		struct Pipeline {
+			std::string_view name;
+			int optimize_level;
+			int shrink_level;
+			wasm::InliningOptions inlining;
+		};
+		static const Pipeline PIPELINES[] = {
+			{ "O2 s2", 2, 2, { .partialInliningIfs = 4 } },
+			{ "O3 s2", 3, 2, { .partialInliningIfs = 4 } },
+			{ "O2 s1", 2, 1, { .partialInliningIfs = 4 } },
+			{ "O3 s1", 3, 1, { .partialInliningIfs = 4 } },
+			// Only tiny functions are inlined
+			{ "O2 s2 no-inline", 2, 2,
+				{ .oneCallerInlineMaxSize = 0, .flexibleInlineMaxSize = 0 } },
+			// Larger functions and ones with loops are inlined too
+			{ "O2 s2 inline", 2, 2,
+				{ .flexibleInlineMaxSize   = 40,
+					.allowFunctionsWithLoops = true,
+					.partialInliningIfs      = 4 } },
+		};
+
+		// Leaves the binary of the final module in buffer
 		void RemoveUnneccesaryInternal(wasm::Module& wasm, std::vector<uint8_t>& in,
-			std::unordered_map<int, std::string>& kept_names) {
+			std::span<const std::string_view> kept_names, const ShrinkOptions& options,
+			const Pipeline& pipeline, wasm::BufferWithRandomAccess& buffer) {
 			wasm::WasmBinaryBuilder parser(wasm, wasm.features, (std::vector<char>&)in);
 			parser.setDebugInfo(false);
 			parser.setDWARF(false);
@@ -71,8 +163,8 @@ namespace Mni {
 			parser.read();
 
 			std::unordered_set<wasm::Name> kept_functions;
-			for(auto& name : kept_names) {
-				kept_functions.insert(wasm::Name(name.second));
+			for(auto name : kept_names) {
+				kept_functions.insert(wasm::Name(std::string(name)));
 			}
 
 			std::vector<wasm::Function*> root_functions;
@@ -98,68 +190,107 @@ namespace Mni {
 			wasm::PassOptions pass_options = { .debug = false,
 				.validate                             = true,
 				.validateGlobally                     = false,
-				.optimizeLevel                        = 2,
-				.shrinkLevel                          = 2,
-				.inlining                             = { .partialInliningIfs = 4 },
+				.optimizeLevel                        = pipeline.optimize_level,
+				.shrinkLevel                          = pipeline.shrink_level,
+				.inlining                             = pipeline.inlining,
 				.trapsNeverHappen                     = true,
 				.fastMath                             = true,
 				.zeroFilledMemory                     = true,
 				.debugInfo                            = false };
 
-			auto runPasses = [&]() {
-				wasm::PassRunner passRunner(&wasm, pass_options);
-				passRunner.addDefaultOptimizationPasses();
-				passRunner.run();
-			};
-			runPasses();
-			if(true) {
-				// Repeatedly run until binary does not decrease in size
-				auto getSize = [&]() {
-					wasm::BufferWithRandomAccess buffer;
-					wasm::WasmBinaryWriter writer(&wasm, buffer);
-					writer.setEmitModuleName(false);
-					writer.setNamesSection(false);
-					writer.write();
-					return buffer.size();
-				};
-				auto lastSize = getSize();
-				while(true) {
-					runPasses();
-					auto currSize = getSize();
-					if(currSize >= lastSize) {
-						break;
+			// Bodies at the start of the previous round, to find what that round changed
+			std::unordered_map<wasm::Name, size_t> previous_hashes;
+			// The same passes as addDefaultOptimizationPasses, returns the functions optimized
+			auto runPasses = [&](bool first) {
+				auto start_hashes = HashBodies(wasm);
+
+				wasm::PassRunner preRunner(&wasm, pass_options);
+				preRunner.addDefaultGlobalOptimizationPrePasses();
+				preRunner.run();
+
+				// Function passes only rerun on bodies changed last round or just now
+				auto current_hashes = HashBodies(wasm);
+				std::vector<wasm::Function*> changed;
+				for(auto& func : wasm.functions) {
+					if(func->imported()) {
+						continue;
+					}
+					auto at_start = start_hashes.find(func->name);
+					auto previous = previous_hashes.find(func->name);
+					if(first || at_start == start_hashes.end() || previous == previous_hashes.end()
+						|| at_start->second != previous->second
+						|| current_hashes[func->name] != at_start->second) {
+						changed.push_back(func.get());
 					}
-					lastSize = currSize;
 				}
+				previous_hashes = std::move(start_hashes);
+
+				if(changed.size() == current_hashes.size()) {
+					// Every body, on Binaryen's threads
+					wasm::PassRunner functionRunner(&wasm, pass_options);
+					functionRunner.addDefaultFunctionOptimizationPasses();
+					functionRunner.run();
+				} else {
+					// Function passes only touch their own body, so the changed ones run in
+					// parallel with their own pass instances like PassRunner::run does
+					Parallel::For(changed.size(), [&](size_t i) {
+						wasm::PassRunner functionRunner(&wasm, pass_options);
+						functionRunner.addDefaultFunctionOptimizationPasses();
+						functionRunner.runOnFunction(changed[i]);
+					});
+				}
+
+				wasm::PassRunner postRunner(&wasm, pass_options);
+				postRunner.addDefaultGlobalOptimizationPostPasses();
+				// Renumber by static use count so the most frequent indices are the smallest
+				// Locals keep their parameters first, types are already written by use count
+				postRunner.add("reorder-functions");
+				postRunner.add("reorder-locals");
+				postRunner.run();
+				ReorderGlobals(wasm);
+				return (uint32_t)changed.size();
+			};
+
+			// Repeatedly run until the estimate does not decrease or the budget is used up
+			auto start         = std::chrono::steady_clock::now();
+			auto last_start    = start;
+			uint64_t last_size = UINT64_MAX;
+			for(uint32_t round = 0; options.max_rounds == 0 || round < options.max_rounds;
+				round++) {
+				auto round_start = std::chrono::steady_clock::now();
+				// Rounds take about as long as the last one, do not start one that would not fit
+				auto last_round = round_start - last_start;
+				if(round != 0 && options.time_budget.count() != 0
+					&& round_start - start + last_round > options.time_budget) {
+					break;
+				}
+				last_start = round_start;
+
+				uint32_t num_functions = runPasses(round == 0);
+				uint64_t size          = EstimateSize(wasm);
+				if(options.rounds) {
+					options.rounds->push_back({ num_functions, size,
+						std::chrono::duration_cast<std::chrono::microseconds>(
+							std::chrono::steady_clock::now() - round_start) });
+				}
+				if(size >= last_size) {
+					break;
+				}
+				last_size = size;
 			}
 
 			// Can iterate through module to identify memory
 			// TODO make name shorter or nonexistant
 			// wasm.removeExport("memory");
-		}
 
-		void RemoveUnneccesary(std::vector<uint8_t>& in, std::vector<uint8_t>& out,
-			std::unordered_map<int, std::string> kept_names) {
-			wasm::Module wasm;
-			RemoveUnneccesaryInternal(wasm, in, kept_names);
-
-			wasm::BufferWithRandomAccess output_buffer;
-			wasm::WasmBinaryWriter writer(&wasm, output_buffer);
+			buffer.clear();
+			wasm::WasmBinaryWriter writer(&wasm, buffer);
 			writer.setEmitModuleName(false);
 			writer.setNamesSection(false);
 			writer.write();
-
-			std::copy(output_buffer.begin(), output_buffer.end(), std::back_inserter(out));
 		}
 
-		void GetExports(std::vector<uint8_t>& in, std::vector<std::string>& names) {
-			wasm::Module wasm;
-			wasm::WasmBinaryBuilder parser(wasm, wasm.features, (std::vector<char>&)in);
-			parser.setDebugInfo(false);
-			parser.setDWARF(false);
-			parser.setSkipFunctionBodies(false);
-			parser.read();
-
+		static void GetFunctionExports(wasm::Module& wasm, std::vector<std::string>& names) {
 			names.clear();
 			for(auto& curr : wasm.exports) {
 				if(curr->kind == wasm::ExternalKind::Function) {
@@ -167,5 +298,102 @@ namespace Mni {
 				}
 			}
 		}
+
+		void RemoveUnneccesary(std::vector<uint8_t>& in, std::vector<uint8_t>& out,
+			std::span<const std::string_view> kept_names, std::vector<std::string>* exports,
+			const ShrinkOptions& options) {
+			if(!options.search) {
+				wasm::Module wasm;
+				wasm::BufferWithRandomAccess buffer;
+				RemoveUnneccesaryInternal(wasm, in, kept_names, options, PIPELINES[0], buffer);
+
+				// Take the writer's buffer instead of copying it
+				out.swap(buffer);
+				if(exports) {
+					GetFunctionExports(wasm, *exports);
+				}
+				return;
+			}
+
+			struct Candidate {
+				std::vector<uint8_t> bytes;
+				std::vector<std::string> exports;
+				std::vector<ShrinkRound> rounds;
+				uint64_t bits = UINT64_MAX;
+			};
+			std::vector<Candidate> candidates(std::size(PIPELINES));
+
+			// Binaryen runs passes on one global thread pool, so candidates take turns with
+			// Binaryen and are scored in parallel. With a target version they are also scored in
+			// turn, so the pipelines after one that fits are skipped
+			std::mutex binaryen_mutex;
+			std::atomic<bool> target_reached { false };
+			Parallel::For(candidates.size(), [&](size_t i) {
+				auto& candidate           = candidates[i];
+				ShrinkOptions shrink      = options;
+				shrink.rounds             = &candidate.rounds;
+				OptimizedOptions encoding = options.encoding;
+				encoding.parallel         = false;
+				encoding.trace            = nullptr;
+
+				std::unique_lock<std::mutex> lock(binaryen_mutex);
+				if(target_reached) {
+					return;
+				}
+				{
+					wasm::Module wasm;
+					wasm::BufferWithRandomAccess buffer;
+					RemoveUnneccesaryInternal(wasm, in, kept_names, shrink, PIPELINES[i], buffer);
+					candidate.bytes.swap(buffer);
+					GetFunctionExports(wasm, candidate.exports);
+				}
+				if(options.target_version == 0) {
+					lock.unlock();
+				}
+
+				std::vector<uint8_t> optimized;
+				candidate.bits = NormalToOptimized(candidate.bytes, 0, optimized, encoding);
+				uint8_t version = Export::QRVersion(candidate.bits);
+				if(options.target_version != 0 && version != 0
+					&& version <= options.target_version) {
+					target_reached = true;
+				}
+			});
+
+			// Fewest bits, the earlier pipeline on ties
+			size_t best = 0;
+			for(size_t i = 0; i < candidates.size(); i++) {
+				if(candidates[i].bits < candidates[best].bits) {
+					best = i;
+				}
+				if(options.searched) {
+					options.searched->push_back({ PIPELINES[i].name, candidates[i].bits });
+				}
+			}
+
+			out.swap(candidates[best].bytes);
+			if(exports) {
+				*exports = std::move(candidates[best].exports);
+			}
+			if(options.rounds) {
+				*options.rounds = std::move(candidates[best].rounds);
+			}
+		}
+
+		bool GetExports(std::vector<uint8_t>& in, std::vector<std::string>& names) {
+			if(ScanExports(in, names)) {
+				return true;
+			}
+
+			// Optimized webassembly, its metadata block lists the exports
+			Metadata metadata;
+			if(ReadMetadata(in, 0, metadata)) {
+				names = std::move(metadata.exports);
+				return true;
+			}
+
+			std::vector<uint8_t> wasm_bytes;
+			return OptimizedToNormal(wasm_bytes, 0, in) != 0 && ScanExports(wasm_bytes, names);
+		}
 	}
 }
\ No newline at end of file
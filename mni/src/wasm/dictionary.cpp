@@ -0,0 +1,33 @@
+#include <mni/wasm/dictionary.hpp>
+
+namespace Mni {
+	namespace Wasm {
+		// Strings emcc and wasi-libc emit for mni codes, taken from the examples
+		// Most common fragments are last so their back references are shortest
+		// clang-format off
+		static constexpr char DICTIONARY_V1[] =
+			"clock_time_getargs_sizes_getargs_getenviron_sizes_getenviron_get"
+			"fd_readfd_seekfd_closefd_writeproc_exitwasi_snapshot_preview1"
+			"__cxa_atexit__dso_handle__data_end__heap_base__stack_pointer"
+			"emscripten_memcpy_bigemscripten_resize_heapemscripten_notify_memory_growth"
+			"emscripten_stack_get_currentemscripten_stack_get_endemscripten_stack_get_base"
+			"emscripten_stack_get_freeemscripten_stack_init"
+			"stackAllocstackRestorestackSave__errno_location"
+			"_initialize__wasm_call_ctors__indirect_function_table"
+			"%d%f%s$0.00 Courier NewHelvetica Arial Hello World! "
+			"mni_rendermni_preparemni_namememorymni.codes ";
+		// clang-format on
+
+		const Mni::Lz::Dictionary* PresetDictionary(uint8_t version) {
+			switch(version) {
+			case 1: {
+				static const Mni::Lz::Dictionary dictionary(
+					{ (const uint8_t*)DICTIONARY_V1, sizeof(DICTIONARY_V1) - 1 });
+				return &dictionary;
+			}
+			default:
+				return nullptr;
+			}
+		}
+	}
+}
@@ -1,6 +1,11 @@
 #include <mni.hpp>
+#include <mni/lz.hpp>
+#include <mni/parallel.hpp>
+#include <mni/wasm/functions.hpp>
 #include <mni/wasm/parser.hpp>
+#include <mni/wasm/signatures.hpp>
 
+#include <cstring>
 #include <memory>
 #include <wasm-binary.h>
 
@@ -148,137 +153,633 @@ namespace Mni {
 			i = 0;
 		}
 
-		void IO::WriteSlice(std::vector<uint8_t> slice) {
+		void IO::WriteSlice(std::span<const uint8_t> slice) {
 			if(slice.size() != 0) {
 				bytes.resize(i + slice.size());
-				std::move(slice.data(), slice.data() + slice.size(), &bytes[i]);
+				std::memcpy(&bytes[i], slice.data(), slice.size());
 				i += slice.size();
 			}
 		}
 
-		void IO::WriteString(std::string str) {
+		void IO::WriteString(std::string_view str) {
 			WriteULEB(str.size());
-			if(str.size() != 0) {
-				bytes.resize(i + str.size());
-				std::move(str.data(), str.data() + str.size(), &bytes[i]);
-				i += str.size();
-			}
+			WriteSlice({ (const uint8_t*)str.data(), str.size() });
 		}
 
 		std::vector<uint8_t> IO::ReadSlice(size_t len) {
-			std::vector<uint8_t> res;
-			std::copy(bytes.data() + i, bytes.data() + i + len, std::back_inserter(res));
+			auto view = ReadSliceView(len);
+			return std::vector<uint8_t>(view.begin(), view.end());
+		}
+
+		std::string IO::ReadString() {
+			return std::string(ReadStringView());
+		}
+
+		std::span<const uint8_t> IO::ReadSliceView(size_t len) {
+			// Clamped to the bytes left, so a truncated module still ends at Done
+			len = std::min(len, bytes.size() - std::min(i, bytes.size()));
+			std::span<const uint8_t> res(bytes.data() + i, len);
 			i += len;
 			return res;
 		}
 
-		std::string IO::ReadString() {
+		std::string_view IO::ReadStringView() {
 			size_t size = ReadULEB();
-			std::string res((char*)&bytes[i], size);
 			// Do not append null byte
-			i += size;
-			return res;
+			auto view = ReadSliceView(size);
+			return std::string_view((const char*)view.data(), view.size());
 		}
 
 		void OptimizedIO::WriteLEB(int64_t num) {
-			current_bit = Mni::Encoding::WriteLEB(num, leb_multiple, current_bit, bytes);
+			// Magnitude bits, the sign bit costs the same for every multiple
+			RecordLEB(Mni::Encoding::GetRequiredBits(num));
+			current_bit = Mni::Encoding::WriteLEB(num, leb_multiple, current_bit, *stream);
 		}
 
 		void OptimizedIO::WriteULEB(uint64_t num) {
-			current_bit = Mni::Encoding::WriteLEBUnsigned(num, leb_multiple, current_bit, bytes);
+			RecordLEB(Mni::Encoding::GetRequiredBits(num));
+			current_bit = Mni::Encoding::WriteLEBUnsigned(num, leb_multiple, current_bit, *stream);
 		}
 
 		int64_t OptimizedIO::ReadLEB() {
 			int64_t out;
-			current_bit = Mni::Decoding::ReadLEB(&out, leb_multiple, current_bit, bytes);
+			current_bit = Mni::Decoding::ReadLEB(&out, leb_multiple, current_bit, *stream);
 			return out;
 		}
 
 		uint64_t OptimizedIO::ReadULEB() {
 			uint64_t out;
-			current_bit = Mni::Decoding::ReadLEBUnsigned(&out, leb_multiple, current_bit, bytes);
+			current_bit = Mni::Decoding::ReadLEBUnsigned(&out, leb_multiple, current_bit, *stream);
 			return out;
 		}
 
 		void OptimizedIO::WriteFloat32(float num) {
-			current_bit = Mni::Encoding::WriteFloat(num, 0, current_bit, bytes);
+			current_bit = Mni::Encoding::WriteFloat(num, 0, current_bit, *stream);
 		}
 
 		float OptimizedIO::ReadFloat32() {
 			float out;
-			current_bit = Mni::Decoding::ReadFloat(&out, 0, current_bit, bytes);
+			current_bit = Mni::Decoding::ReadFloat(&out, 0, current_bit, *stream);
 			return out;
 		}
 
 		void OptimizedIO::WriteFloat64(double num) {
-			current_bit = Mni::Encoding::WriteDouble(num, 0, current_bit, bytes);
+			current_bit = Mni::Encoding::WriteDouble(num, 0, current_bit, *stream);
 		}
 
 		double OptimizedIO::ReadFloat64() {
 			double out;
-			current_bit = Mni::Decoding::ReadDouble(&out, 0, current_bit, bytes);
+			current_bit = Mni::Decoding::ReadDouble(&out, 0, current_bit, *stream);
 			return out;
 		}
 
 		void OptimizedIO::WriteNum(int64_t num, uint8_t bit_size) {
-			current_bit = Mni::Encoding::WriteNum(num, bit_size, current_bit, bytes);
+			current_bit = Mni::Encoding::WriteNum(num, bit_size, current_bit, *stream);
 		}
 
 		int64_t OptimizedIO::ReadNum(uint8_t bit_size) {
 			int64_t out;
-			current_bit = Mni::Decoding::ReadNum(&out, bit_size, current_bit, bytes);
+			current_bit = Mni::Decoding::ReadNum(&out, bit_size, current_bit, *stream);
 			return out;
 		}
 
 		void OptimizedIO::WriteUNum(uint64_t num, uint8_t bit_size) {
-			current_bit = Mni::Encoding::WriteNumUnsigned(num, bit_size, current_bit, bytes);
+			current_bit = Mni::Encoding::WriteNumUnsigned(num, bit_size, current_bit, *stream);
 		}
 
 		uint64_t OptimizedIO::ReadUNum(uint8_t bit_size) {
 			uint64_t out;
-			current_bit = Mni::Decoding::ReadNumUnsigned(&out, bit_size, current_bit, bytes);
+			current_bit = Mni::Decoding::ReadNumUnsigned(&out, bit_size, current_bit, *stream);
 			return out;
 		}
 
-		void OptimizedIO::WriteSlice(std::vector<uint8_t>& slice) {
-			Mni::Encoding::CopyBits(0, slice.size() * 8, current_bit, slice, bytes);
-			current_bit += slice.size() * 8;
+		void OptimizedIO::WriteSlice(std::span<const uint8_t> slice) {
+			if(slice.size() == 0) {
+				return;
+			}
+			uint64_t end_bit = current_bit + slice.size() * 8;
+			if(stream->size() < (end_bit + 7) / 8) {
+				stream->resize((end_bit + 7) / 8);
+			}
+			current_bit = Mni::Encoding::CopyBits(
+				0, slice.size() * 8, current_bit, slice.data(), stream->data());
 		}
 
-		void OptimizedIO::WriteString(std::string& str) {
+		void OptimizedIO::WriteString(std::string_view str) {
 			// TODO will use huffman
-			std::vector<uint8_t> str_slice(str.begin(), str.end());
-			Mni::Encoding::CopyBits(0, str.size() * 8, current_bit, str_slice, bytes);
-			current_bit += str.size() * 8;
+			WriteSlice({ (const uint8_t*)str.data(), str.size() });
 		}
 
 		std::vector<uint8_t> OptimizedIO::ReadSlice(size_t len) {
+			if(len > BitsLeft() / 8) {
+				failed = true;
+				return std::vector<uint8_t>();
+			}
 			std::vector<uint8_t> out(len);
-			Mni::Encoding::CopyBits(current_bit, current_bit + len * 8, 0, bytes, out);
+			Mni::Encoding::CopyBits(
+				current_bit, current_bit + len * 8, 0, stream->data(), out.data());
 			current_bit += len * 8;
 			return out;
 		}
 
 		std::string OptimizedIO::ReadString(size_t len) {
-			std::vector<uint8_t> out(len);
-			Mni::Encoding::CopyBits(current_bit, current_bit + len * 8, 0, bytes, out);
+			if(len > BitsLeft() / 8) {
+				failed = true;
+				return std::string();
+			}
+			std::string out(len, '\0');
+			Mni::Encoding::CopyBits(
+				current_bit, current_bit + len * 8, 0, stream->data(), (uint8_t*)out.data());
 			current_bit += len * 8;
-			return std::string(out.begin(), out.end());
+			return out;
+		}
+
+		void OptimizedIO::WriteData(std::span<const uint8_t> data) {
+			if(data.size() == 0) {
+				return;
+			}
+
+			// Only use tokens when they beat 8 bits per byte
+			auto tokens   = Mni::Lz::Parse(data, dictionary);
+			auto& table   = huffman.Get<DATA>();
+			auto ULEBBits = [&](uint64_t value) -> uint64_t {
+				return value == 0 ? leb_multiple + 1
+								  : Mni::Encoding::GetRequiredLEBBits(value, leb_multiple);
+			};
+			uint64_t lz_bits = 0;
+			for(auto& token : tokens) {
+				switch(token.type) {
+				case Mni::Lz::LITERAL:
+					lz_bits += 1 + (table.rep ? table.rep_map.at(token.literal).bit_size : 8);
+					break;
+				case Mni::Lz::ZERO_RUN:
+					lz_bits += 2 + ULEBBits(token.length - Mni::Lz::MIN_ZERO_RUN);
+					break;
+				case Mni::Lz::MATCH:
+					lz_bits += 2 + ULEBBits(token.length - Mni::Lz::MIN_MATCH)
+							   + ULEBBits(token.distance - 1);
+					break;
+				}
+			}
+
+			bool compressed = lz_bits < data.size() * 8;
+			WriteUNum(compressed, 1);
+			if(!compressed) {
+				WriteSlice(data);
+				return;
+			}
+
+			for(auto& token : tokens) {
+				switch(token.type) {
+				case Mni::Lz::LITERAL:
+					WriteUNum(0, 1);
+					WriteCoded<DATA>(token.literal);
+					break;
+				case Mni::Lz::ZERO_RUN:
+					WriteUNum(0b10, 2);
+					WriteULEB(token.length - Mni::Lz::MIN_ZERO_RUN);
+					break;
+				case Mni::Lz::MATCH:
+					WriteUNum(0b11, 2);
+					WriteULEB(token.length - Mni::Lz::MIN_MATCH);
+					WriteULEB(token.distance - 1);
+					break;
+				}
+			}
+		}
+
+		std::vector<uint8_t> OptimizedIO::ReadData(size_t len) {
+			if(len == 0) {
+				return std::vector<uint8_t>();
+			}
+			// Compressed data can be much larger than its bits, so it has its own limit
+			if(len > data_left) {
+				failed = true;
+				return std::vector<uint8_t>();
+			}
+			data_left -= len;
+
+			bool compressed = ReadUNum(1);
+			if(!compressed) {
+				return ReadSlice(len);
+			}
+
+			std::vector<uint8_t> out;
+			out.reserve(len);
+			while(out.size() < len && current_bit <= end_bit) {
+				if(!ReadUNum(1)) {
+					out.push_back(ReadCoded<DATA>());
+				} else if(!ReadUNum(1)) {
+					size_t length = ReadULEB() + Mni::Lz::MIN_ZERO_RUN;
+					out.resize(std::min(out.size() + length, len));
+				} else {
+					size_t length   = ReadULEB() + Mni::Lz::MIN_MATCH;
+					size_t distance = ReadULEB() + 1;
+					auto preset = dictionary ? dictionary->bytes : std::span<const uint8_t>();
+					if(out.size() + length > len
+						|| !Mni::Lz::AppendMatch(out, distance, length, preset)) {
+						failed = true;
+						return std::vector<uint8_t>();
+					}
+				}
+			}
+			out.resize(len);
+			return out;
+		}
+
+		void OptimizedIO::WriteBits(std::vector<uint8_t>& src, uint64_t bits) {
+			current_bit = Mni::Encoding::CopyBits(0, bits, current_bit, src, *stream);
+		}
+
+		bool OptimizedIO::ReadHeader() {
+			if(ReadUNum(FORMAT_VERSION_BITS) != FORMAT_VERSION) {
+				failed = true;
+				return false;
+			}
+			size              = ReadULEB();
+			uint16_t checksum = ReadUNum(CHECKSUM_BITS);
+			// Webassembly starts after the header is read
+			original_current_bit = current_bit;
+			if(size > BitsLeft()
+				|| Mni::Decoding::Crc16(current_bit, size, bytes) != checksum) {
+				failed = true;
+				return false;
+			}
+			// Nothing past the exact length belongs to the stream, like QR code padding
+			end_bit = current_bit + size;
+			return true;
 		}
 
-		void OptimizedIO::PrependSize() {
+		void OptimizedIO::PrependHeader() {
 			// Move entire module
-			size           = current_bit - original_current_bit;
-			auto size_bits = Mni::Encoding::GetRequiredLEBBits(
-				current_bit - original_current_bit, leb_multiple);
+			size                 = current_bit - original_current_bit;
+			uint16_t checksum    = Mni::Decoding::Crc16(original_current_bit, size, bytes);
+			uint64_t header_bits = FORMAT_VERSION_BITS
+								   + Mni::Encoding::GetRequiredLEBBits(size, leb_multiple)
+								   + CHECKSUM_BITS;
 			current_bit = Mni::Encoding::MoveBits(
-				original_current_bit, current_bit, original_current_bit + size_bits, bytes);
-			// Write size at beginning
+				original_current_bit, current_bit, original_current_bit + header_bits, bytes);
+			// Write header at beginning
+			original_current_bit = Mni::Encoding::WriteNumUnsigned(
+				FORMAT_VERSION, FORMAT_VERSION_BITS, original_current_bit, bytes);
 			original_current_bit
 				= Mni::Encoding::WriteLEBUnsigned(size, leb_multiple, original_current_bit, bytes);
+			original_current_bit = Mni::Encoding::WriteNumUnsigned(
+				checksum, CHECKSUM_BITS, original_current_bit, bytes);
+		}
+
+		bool OptimizedIO::SealHeader() {
+			if(ReadUNum(FORMAT_VERSION_BITS) != FORMAT_VERSION) {
+				return false;
+			}
+			size = ReadULEB();
+			if(CHECKSUM_BITS > BitsLeft() || size > BitsLeft() - CHECKSUM_BITS) {
+				return false;
+			}
+			uint16_t checksum = Mni::Decoding::Crc16(current_bit + CHECKSUM_BITS, size, bytes);
+			Mni::Encoding::WriteNumUnsigned(checksum, CHECKSUM_BITS, current_bit, bytes);
+			return true;
+		}
+
+		std::array<uint8_t, NUM_COLUMNS> OptimizedIO::ChooseColumnLEBMultiples() {
+			std::array<uint8_t, NUM_COLUMNS> multiples;
+			for(uint8_t i = 0; i < NUM_COLUMNS; i++) {
+				auto& leb_bits     = column_state[i].leb_bits;
+				uint64_t best_size = UINT64_MAX;
+				// Multiples are stored in 3 bits
+				for(uint8_t multiple = 1; multiple <= 8; multiple++) {
+					// 0 still takes one group
+					uint64_t size = leb_bits[0] * (multiple + 1);
+					for(uint8_t bits = 1; bits < leb_bits.size(); bits++) {
+						size += leb_bits[bits] * ((bits + multiple - 1) / multiple) * (multiple + 1);
+					}
+					if(size < best_size) {
+						best_size    = size;
+						multiples[i] = multiple;
+					}
+				}
+			}
+			return multiples;
+		}
+
+		void OptimizedIO::SetColumnLEBMultiples(std::array<uint8_t, NUM_COLUMNS> multiples) {
+			for(uint8_t i = 0; i < NUM_COLUMNS; i++) {
+				column_state[i].leb_multiple = multiples[i];
+			}
+		}
+
+		void OptimizedIO::WriteColumnHeader() {
+			for(auto& column : column_state) {
+				WriteUNum(column.leb_multiple - 1, 3);
+			}
+		}
+
+		void OptimizedIO::ReadColumnHeader() {
+			for(auto& column : column_state) {
+				column.leb_multiple = ReadUNum(3) + 1;
+			}
+
+			std::array<uint64_t, NUM_COLUMNS> lengths;
+			for(auto& length : lengths) {
+				length = ReadULEB();
+			}
+
+			// Columns follow each other directly after the lengths
+			uint64_t column_start = current_bit;
+			for(uint8_t i = 0; i < NUM_COLUMNS; i++) {
+				column_state[i].current_bit = column_start;
+				column_state[i].end_bit     = column_start + lengths[i];
+				column_start += lengths[i];
+			}
+
+			columns           = true;
+			columns_active    = true;
+			main_current_bit  = current_bit;
+			main_leb_multiple = leb_multiple;
+			active_column     = COLUMN_OPCODE;
+			current_bit       = column_state[active_column].current_bit;
+			leb_multiple      = column_state[active_column].leb_multiple;
+		}
+
+		void OptimizedIO::StartColumns() {
+			for(auto& column : column_state) {
+				column.bytes.clear();
+				column.current_bit = 0;
+				column.leb_bits.fill(0);
+			}
+
+			columns_active    = true;
+			main_current_bit  = current_bit;
+			main_leb_multiple = leb_multiple;
+			active_column     = COLUMN_OPCODE;
+			stream            = &column_state[active_column].bytes;
+			current_bit       = 0;
+			leb_multiple      = column_state[active_column].leb_multiple;
+		}
+
+		void OptimizedIO::EndColumns() {
+			column_state[active_column].current_bit = current_bit;
+			columns_active                          = false;
+			leb_multiple                            = main_leb_multiple;
+
+			if(stream == &bytes) {
+				// Reading, continue after the last column
+				current_bit = column_state[NUM_COLUMNS - 1].end_bit;
+				return;
+			}
+
+			// Writing, append lengths and then every column to the main stream
+			stream      = &bytes;
+			current_bit = main_current_bit;
+			for(auto& column : column_state) {
+				WriteULEB(column.current_bit);
+			}
+			for(auto& column : column_state) {
+				current_bit = Mni::Encoding::CopyBits(
+					0, column.current_bit, current_bit, column.bytes, bytes);
+			}
+		}
+
+		uint64_t OptimizedIO::TracedBit(uint8_t column) {
+			if(traced_io) {
+				return traced_io->GetPos() * 8;
+			}
+			if(!columns_active || column == active_column) {
+				return current_bit;
+			}
+			return column_state[column].current_bit;
+		}
+
+		void OptimizedIO::Trace(WasmItemType type) {
+			uint8_t column = columns_active ? active_column : 0;
+			uint64_t bit   = TracedBit(column);
+			if(traced_last[column] != SIZE_MAX) {
+				auto& last = (*trace)[traced_last[column]];
+				last.bits  = bit - last.bit;
+			}
+			traced_last[column] = trace->size();
+			trace->push_back({ type, 0, bit, 0, traced_section, traced_function });
+		}
+
+		void OptimizedIO::EndTrace() {
+			if(!trace) {
+				return;
+			}
+			for(uint8_t column = 0; column < NUM_COLUMNS; column++) {
+				if(traced_last[column] != SIZE_MAX) {
+					auto& last = (*trace)[traced_last[column]];
+					last.bits  = TracedBit(column) - last.bit;
+				}
+			}
+			traced_last.fill(SIZE_MAX);
+		}
+
+		void OptimizedIO::WriteMetadata() {
+			WriteUNum(metadata, 1);
+			if(!metadata) {
+				return;
+			}
+
+			WriteULEB(meta.name.size());
+			if(meta.name.size() != 0) {
+				WriteString(meta.name);
+			}
+			WriteULEB(meta.width);
+			WriteULEB(meta.height);
+
+			WriteULEB(meta.imports.size());
+			for(auto& name : meta.imports) {
+				// Known runtime functions only need their id
+				int32_t id = DEFINED_FUNCTIONS.Find(name);
+				if(id != -1) {
+					WriteUNum(1, 1);
+					WriteULEB(id);
+				} else {
+					WriteUNum(0, 1);
+					WriteULEB(name.size());
+					if(name.size() != 0) {
+						WriteString(name);
+					}
+				}
+			}
+
+			// Runtime functions as a mask of their ids, which is all a purged module exports
+			static_assert(std::size(INCLUDED_FUNCTIONS) <= 64, "Ids must fit the export mask");
+			uint64_t defined_exports = 0;
+			std::vector<std::string_view> other_exports;
+			for(auto& name : meta.exports) {
+				int32_t id = DEFINED_FUNCTIONS.Find(name);
+				if(id != -1) {
+					defined_exports |= 1ULL << id;
+				} else {
+					other_exports.push_back(name);
+				}
+			}
+			WriteULEB(defined_exports);
+			WriteULEB(other_exports.size());
+			for(auto name : other_exports) {
+				WriteULEB(name.size());
+				if(name.size() != 0) {
+					WriteString(name);
+				}
+			}
+
+			WriteULEB(meta.features);
+		}
+
+		void OptimizedIO::ReadMetadata() {
+			metadata = ReadUNum(1);
+			meta     = Metadata {};
+			if(!metadata) {
+				return;
+			}
+
+			size_t name_size = ReadULEB();
+			meta.name        = name_size == 0 ? std::string() : ReadString(name_size);
+			meta.width       = ReadULEB();
+			meta.height      = ReadULEB();
+
+			uint64_t num_imports = ReadULEB();
+			if(num_imports > BitsLeft()) {
+				failed = true;
+				return;
+			}
+			for(uint64_t i = 0; i < num_imports; i++) {
+				if(ReadUNum(1)) {
+					uint32_t id = ReadULEB();
+					if(!DEFINED_FUNCTIONS.Contains(id)) {
+						failed = true;
+						return;
+					}
+					meta.imports.push_back(std::string(DEFINED_FUNCTIONS.Name(id)));
+				} else {
+					size_t size = ReadULEB();
+					meta.imports.push_back(size == 0 ? std::string() : ReadString(size));
+				}
+			}
+
+			uint64_t defined_exports = ReadULEB();
+			for(uint32_t id = 0; id < 64; id++) {
+				if(defined_exports & (1ULL << id)) {
+					if(!DEFINED_FUNCTIONS.Contains(id)) {
+						failed = true;
+						return;
+					}
+					meta.exports.push_back(std::string(DEFINED_FUNCTIONS.Name(id)));
+				}
+			}
+			uint64_t num_exports = ReadULEB();
+			if(num_exports > BitsLeft()) {
+				failed = true;
+				return;
+			}
+			for(uint64_t i = 0; i < num_exports; i++) {
+				size_t size = ReadULEB();
+				meta.exports.push_back(size == 0 ? std::string() : ReadString(size));
+			}
+
+			meta.features = ReadULEB();
+			failed |= current_bit > end_bit;
+		}
+
+		void OptimizedIO::WriteDictionaryVersion() {
+			WriteUNum(dictionary_version, DICTIONARY_VERSION_BITS);
+		}
+
+		bool OptimizedIO::ReadDictionaryVersion() {
+			SetDictionary(ReadUNum(DICTIONARY_VERSION_BITS));
+			return dictionary_version == 0 || dictionary != nullptr;
+		}
+
+		void OptimizedIO::ChooseBlockTable() {
+			auto& top   = huffman.Get<INSTRUCTION>();
+			auto& block = huffman.Get<BLOCK_OPCODE>();
+			GenerateHuffmanReps();
+			uint64_t split_size = top.size + block.size;
+
+			auto top_frequencies = top.frequencies;
+			top.Merge(block);
+			GenerateHuffmanReps();
+			if(block.rep && split_size < top.size) {
+				top.frequencies = std::move(top_frequencies);
+			} else {
+				// Instructions inside blocks share the top level table
+				block.frequencies.clear();
+			}
+		}
+
+		void OptimizedIO::WriteFunctionIndex() {
+			WriteUNum(function_index, 1);
+			// Table is inserted here once every body has been written
+			function_index_bit = current_bit;
+		}
+
+		void OptimizedIO::ReadFunctionIndex() {
+			function_index = ReadUNum(1);
+			function_starts.clear();
+			if(!function_index) {
+				return;
+			}
+
+			uint64_t num_functions = ReadULEB();
+			if(num_functions > BitsLeft()) {
+				failed = true;
+				return;
+			}
+			std::vector<uint64_t> lengths;
+			uint64_t first_offset = num_functions == 0 ? 0 : ReadULEB();
+			for(uint64_t i = 0; i < num_functions; i++) {
+				lengths.push_back(ReadULEB());
+			}
+
+			// Offset is relative to the first item after the header
+			uint64_t body_start = current_bit + first_offset;
+			for(auto length : lengths) {
+				function_starts.push_back(body_start);
+				body_start += length;
+				// Bodies past the end of the stream
+				failed |= length > end_bit || body_start > end_bit;
+			}
+			function_starts.push_back(body_start);
+			failed |= first_offset > end_bit || body_start > end_bit;
+		}
+
+		void OptimizedIO::InsertFunctionIndex(std::vector<uint64_t>& function_bits) {
+			std::vector<uint8_t> table;
+			uint64_t table_bits    = 0;
+			uint64_t num_functions = function_bits.empty() ? 0 : function_bits.size() - 1;
+			table_bits = Mni::Encoding::WriteLEBUnsigned(num_functions, leb_multiple, table_bits, table);
+			if(num_functions != 0) {
+				table_bits = Mni::Encoding::WriteLEBUnsigned(
+					function_bits[0] - function_index_bit, leb_multiple, table_bits, table);
+				for(uint64_t i = 0; i < num_functions; i++) {
+					table_bits = Mni::Encoding::WriteLEBUnsigned(
+						function_bits[i + 1] - function_bits[i], leb_multiple, table_bits, table);
+				}
+			}
+
+			current_bit = Mni::Encoding::MoveBits(
+				function_index_bit, current_bit, function_index_bit + table_bits, *stream);
+			Mni::Encoding::CopyBits(0, table_bits, function_index_bit, table, *stream);
+		}
+
+		void OptimizedIO::SwitchColumn(WasmColumn column) {
+			if(column == active_column) {
+				return;
+			}
+
+			column_state[active_column].current_bit = current_bit;
+			active_column                           = column;
+			current_bit                             = column_state[column].current_bit;
+			leb_multiple                            = column_state[column].leb_multiple;
+			if(stream != &bytes) {
+				// Only writing uses separate buffers
+				stream = &column_state[column].bytes;
+			}
 		}
 
-		static std::unordered_map<wasm::BinaryConsts::ASTNodes, std::string> instruction_to_name = {
+		static constexpr std::pair<wasm::BinaryConsts::ASTNodes, std::string_view>
+			INSTRUCTION_NAME_LIST[] = {
 			{ wasm::BinaryConsts::Unreachable, "unreachable" },
 			{ wasm::BinaryConsts::Nop, "nop" },
 			{ wasm::BinaryConsts::Block, "block" },
@@ -478,39 +979,52 @@ namespace Mni {
 			{ wasm::BinaryConsts::RefFunc, "ref.func" },
 		};
 
-		static std::unordered_map<WasmItemType, std::string> item_type_to_name = {
-			{ NUM, "NUM" },
-			{ SIZE, "SIZE" },
-			{ SECTION, "SECTION" },
-			{ STRING, "STRING" },
-			{ TYPE, "TYPE" },
-			{ INDEXED_TYPE, "INDEXED_TYPE" },
-			{ LIMIT, "LIMIT" },
-			{ MEMORY_OP, "MEMORY_OP" },
-			{ INSTRUCTION, "INSTRUCTION" },
-			{ INSTRUCTION32, "INSTRUCTION32" },
-			{ ATTRIBUTE, "ATTRIBUTE" },
-			{ BREAK, "BREAK" },
-			{ FUNCTION, "FUNCTION" },
-			{ TABLE, "TABLE" },
-			{ LOCAL, "LOCAL" },
-			{ GLOBAL, "GLOBAL" },
-			{ MEMORY, "MEMORY" },
-			{ TAG, "TAG" },
-			{ I32, "I32" },
-			{ I64, "I64" },
-			{ I128, "I128" },
-			{ F32, "F32" },
-			{ F64, "F64" },
-			{ ATOMIC_ORDER, "ATOMIC_ORDER" },
-			{ SEGMENT, "SEGMENT" },
-			{ MEMORY_IDX, "MEMORY_IDX" },
-			{ LANE, "LANE" },
-			{ STRUCT, "STRUCT" },
-			{ EXTERNAL, "EXTERNAL" },
-			{ FLAGS, "FLAGS" },
-			{ DATA, "DATA" },
+		// Names by opcode, empty for unnamed opcodes
+		static constexpr auto INSTRUCTION_NAMES = [] {
+			std::array<std::string_view, 256> names {};
+			for(auto [node, name] : INSTRUCTION_NAME_LIST) {
+				names[node] = name;
+			}
+			return names;
+		}();
+
+		// Names by item type, in the order of WasmItemType
+		static constexpr std::string_view ITEM_TYPE_NAMES[] = {
+			"NUM",
+			"SIZE",
+			"SECTION",
+			"STRING",
+			"TYPE",
+			"INDEXED_TYPE",
+			"LIMIT",
+			"MEMORY_OP",
+			"INSTRUCTION",
+			"INSTRUCTION32",
+			"BLOCK_OPCODE",
+			"ATTRIBUTE",
+			"BREAK",
+			"FUNCTION",
+			"TABLE",
+			"LOCAL",
+			"GLOBAL",
+			"MEMORY",
+			"TAG",
+			"I32",
+			"I64",
+			"I128",
+			"F32",
+			"F64",
+			"ATOMIC_ORDER",
+			"SEGMENT",
+			"MEMORY_IDX",
+			"LANE",
+			"STRUCT",
+			"EXTERNAL",
+			"FLAGS",
+			"DATA",
+			"ENCODED",
 		};
+		static_assert(std::size(ITEM_TYPE_NAMES) == ENCODED + 1);
 
 		struct WasmItem {
 			WasmItemType type;
@@ -564,8 +1078,10 @@ namespace Mni {
 			uint64_t size;
 		};
 
+		// Views either into the input bytes, which outlive the items, or into storage
 		struct WasmString : public WasmItem {
-			std::string str;
+			std::string storage;
+			std::string_view str;
 		};
 
 		struct WasmIndex : public WasmItem {
@@ -619,13 +1135,262 @@ namespace Mni {
 		};
 
 		struct WasmData : public WasmItem {
-			std::vector<uint8_t> data;
+			std::vector<uint8_t> storage;
+			std::span<const uint8_t> data;
 		};
 
-		void ConvertWasm(ParsingMode in, ParsingMode out, IO& io, OptimizedIO& opt_io) {
+		static WasmString* NewString(std::string_view view) {
+			return new WasmString { { STRING }, std::string(), view };
+		}
+
+		static WasmString* NewString(std::string storage) {
+			auto item = new WasmString { { STRING }, std::move(storage) };
+			item->str = item->storage;
+			return item;
+		}
+
+		static WasmData* NewData(std::span<const uint8_t> view) {
+			return new WasmData { { DATA }, std::vector<uint8_t>(), view };
+		}
+
+		static WasmData* NewData(std::vector<uint8_t> storage) {
+			auto item  = new WasmData { { DATA }, std::move(storage) };
+			item->data = item->storage;
+			return item;
+		}
+
+		struct WasmEncoded : public WasmItem {
+			std::vector<uint8_t> bytes;
+			uint64_t bits;
+		};
 
+		// Items parsed once and kept for every following write pass
+		struct ParsedWasm {
 			std::vector<WasmItem*> items;
-			size_t item_idx = 0;
+			// Item index of every function body followed by the end of the last
+			std::vector<size_t> function_items;
+			// Offset and data item of every active segment at a constant offset
+			std::vector<std::pair<int32_t, size_t>> active_segments;
+			// Whether every active segment is listed in active_segments, moving only some out
+			// would reorder them against the segments applied during instantiation
+			bool all_segments_constant = true;
+			// Item index of the data section, SIZE_MAX if there is none
+			size_t data_section = SIZE_MAX;
+			bool has_start      = false;
+			// Whether memory 0 is exported and no other memory is, so its segments can be
+			// copied in through the export
+			bool exports_memory       = false;
+			bool exports_other_memory = false;
+			// Bodies being written on their own only borrow the module's items
+			bool owns_items = true;
+
+			~ParsedWasm() {
+				if(!owns_items) {
+					return;
+				}
+				for(auto item : items) {
+					// Deallocate webassembly items, items owning buffers need their own type
+					switch(item->type) {
+					case STRING:
+						delete (WasmString*)item;
+						break;
+					case DATA:
+						delete (WasmData*)item;
+						break;
+					default:
+						delete item;
+						break;
+					}
+				}
+			}
+		};
+
+		enum ConvertScope {
+			SCOPE_MODULE,
+			SCOPE_FUNCTION_BODY, // Single code section entry without any header
+		};
+
+		// in may be NONE to write the items of parsed without reading them again
+		void ConvertWasm(ParsingMode in, ParsingMode out, IO& io, OptimizedIO& opt_io,
+			ConvertScope scope = SCOPE_MODULE, bool parallel = false,
+			ParsedWasm* parsed = nullptr);
+
+		// Returns whether the items are split into columns
+		static bool ReadOptimizedHeader(OptimizedIO& opt_io) {
+			if(!opt_io.ReadHeader()) {
+				return false;
+			}
+			opt_io.ReadMetadata();
+			// Streams built with a dictionary this build lacks can't be decoded
+			if(!opt_io.ReadDictionaryVersion()) {
+				opt_io.Fail();
+				return false;
+			}
+
+			// Starting with whether the stream is split into columns
+			bool columns = opt_io.ReadUNum(1);
+			opt_io.SetStructured(opt_io.ReadUNum(1));
+			// Then huffman trees for every item type that has one
+			opt_io.ReadHuffmanHeaders();
+			opt_io.ReadFunctionIndex();
+			if(columns) {
+				opt_io.ReadColumnHeader();
+			}
+			return columns;
+		}
+
+		static uint64_t LEBBytes(int64_t num) {
+			uint64_t bytes = 1;
+			while(num < -64 || num > 63) {
+				num >>= 7;
+				bytes++;
+			}
+			return bytes;
+		}
+
+		static uint64_t ULEBBytes(uint64_t num) {
+			uint64_t bytes = 1;
+			while(num >>= 7) {
+				bytes++;
+			}
+			return bytes;
+		}
+
+		// Bytes WRITE_NORMAL uses for an item, only covers items found in function bodies
+		static uint64_t NormalSize(WasmItem* item) {
+			switch(item->type) {
+			case NUM:
+				return ULEBBytes(((WasmNumber*)item)->num);
+			case SIZE:
+				return ULEBBytes(((WasmSize*)item)->size);
+			case TYPE:
+				return LEBBytes(((WasmType*)item)->type);
+			case INDEXED_TYPE:
+				return ULEBBytes(((WasmIndexedType*)item)->type);
+			case MEMORY_OP:
+				return ULEBBytes(((WasmMemoryOp*)item)->align)
+					   + ULEBBytes(((WasmMemoryOp*)item)->offset);
+			case INSTRUCTION:
+			case ATTRIBUTE:
+			case MEMORY_IDX:
+			case LANE:
+				return 1;
+			case INSTRUCTION32:
+				return ULEBBytes(((WasmInstruction32*)item)->node);
+			case BREAK:
+				return ULEBBytes(((WasmBreak*)item)->offset);
+			case FUNCTION:
+			case TABLE:
+			case LOCAL:
+			case GLOBAL:
+			case MEMORY:
+			case TAG:
+			case STRUCT:
+				return ULEBBytes(((WasmIndex*)item)->index);
+			case I32:
+				return LEBBytes(((WasmI32*)item)->literal);
+			case I64:
+				return LEBBytes(((WasmI64*)item)->literal);
+			case I128:
+				return 16;
+			case F32:
+				return 4;
+			case F64:
+				return 8;
+			case ATOMIC_ORDER:
+				return ULEBBytes(((WasmAtomicOrder*)item)->order);
+			case SEGMENT:
+				return ULEBBytes(((WasmSegment*)item)->segment);
+			default:
+				return 0;
+			}
+		}
+
+		// Whether every body is exactly as long as its items, which lets the final end of each
+		// body be found from its size
+		static bool BodySizesMatch(ParsedWasm& parsed) {
+			auto& function_items = parsed.function_items;
+			for(size_t i = 0; i + 1 < function_items.size(); i++) {
+				uint64_t size = 0;
+				for(size_t j = function_items[i] + 1; j < function_items[i + 1]; j++) {
+					size += NormalSize(parsed.items[j]);
+				}
+				if(size != ((WasmSize*)parsed.items[function_items[i]])->size) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Index into KNOWN_SIGNATURES of the function type starting at item index start
+		static uint8_t MatchSignature(std::vector<WasmItem*>& items, size_t start) {
+			auto TypeAt = [&](size_t i) {
+				return i < items.size() && items[i]->type == TYPE ? ((WasmType*)items[i])->type
+																  : 0;
+			};
+			auto NumAt = [&](size_t i) {
+				return i < items.size() && items[i]->type == NUM ? ((WasmNumber*)items[i])->num
+																 : UINT32_MAX;
+			};
+
+			uint32_t num_params  = NumAt(start + 1);
+			uint32_t num_results = NumAt(start + 2 + num_params);
+			for(uint8_t id = 0; id < std::size(KNOWN_SIGNATURES); id++) {
+				auto& signature = KNOWN_SIGNATURES[id];
+				if(signature.num_params != num_params || signature.num_results != num_results) {
+					continue;
+				}
+				bool match = true;
+				for(uint32_t i = 0; i < num_params; i++) {
+					match &= TypeAt(start + 2 + i) == signature.params[i];
+				}
+				if(num_results == 1) {
+					match &= TypeAt(start + 3 + num_params) == signature.result;
+				}
+				if(match) {
+					return id;
+				}
+			}
+			return NO_SIGNATURE;
+		}
+
+		// Decodes one body starting at current_bit, returns the bit after the body
+		// header_io has already read the header
+		// Returns UINT64_MAX if the body is damaged
+		static uint64_t DecodeFunctionBody(OptimizedIO& header_io, uint64_t current_bit,
+			uint64_t end_bit, std::vector<uint8_t>& body) {
+			IO io(body, header_io.huffman);
+			OptimizedIO opt_io(header_io.GetBytes(), current_bit, header_io.huffman);
+			opt_io.SetReadLimits(end_bit);
+			opt_io.SetStructured(header_io.IsStructured());
+			ConvertWasm(READ_OPTIMIZED, WRITE_NORMAL, io, opt_io, SCOPE_FUNCTION_BODY);
+			return opt_io.Failed() ? UINT64_MAX : opt_io.GetCurrentBit();
+		}
+
+		void ConvertWasm(ParsingMode in, ParsingMode out, IO& io, OptimizedIO& opt_io,
+			ConvertScope scope, bool parallel, ParsedWasm* parsed) {
+
+			ParsedWasm local_parsed;
+			auto& items          = parsed ? parsed->items : local_parsed.items;
+			auto& function_items = parsed ? parsed->function_items : local_parsed.function_items;
+			auto& active_segments
+				= parsed ? parsed->active_segments : local_parsed.active_segments;
+			auto& all_segments_constant
+				= parsed ? parsed->all_segments_constant : local_parsed.all_segments_constant;
+			auto& data_section = parsed ? parsed->data_section : local_parsed.data_section;
+			auto& has_start    = parsed ? parsed->has_start : local_parsed.has_start;
+			auto& exports_memory = parsed ? parsed->exports_memory : local_parsed.exports_memory;
+			auto& exports_other_memory
+				= parsed ? parsed->exports_other_memory : local_parsed.exports_other_memory;
+			size_t item_idx    = 0;
+
+			// Collected while counting to fill in the metadata block
+			bool extract_metadata = in == READ_NORMAL && out == NONE && opt_io.HasMetadata();
+			// Views into the string items
+			std::vector<std::string_view> imported_functions;
+			std::unordered_map<std::string_view, uint32_t> exported_functions;
+			// Item range of bodies by defined function index
+			std::unordered_map<uint32_t, std::pair<size_t, size_t>> body_items;
 
 			ParsingMode mode = READ_NORMAL;
 
@@ -634,6 +1399,7 @@ namespace Mni {
 				uint64_t maximum;
 			};
 			auto HandleLimits = [&]() {
+				opt_io.SetItemType(LIMIT);
 				switch(mode) {
 				case READ_NORMAL: {
 					// Flags must be 0 or 1
@@ -673,10 +1439,29 @@ namespace Mni {
 				return Limits { 0, 0 };
 			};
 
+			// Opcode the next immediates belong to, tracked in every mode so predictions match
+			uint8_t last_instruction = wasm::BinaryConsts::Unreachable;
+
+			// Known signature of every function type in the type section
+			std::vector<uint8_t> type_signatures;
+			// Id of the last string if it is a known function name, otherwise -1
+			int32_t known_name = -1;
+			// Signature of a known function import until its type index is handled
+			uint8_t import_signature = NO_SIGNATURE;
+			auto FindType            = [&](uint8_t signature) {
+				auto type = std::find(type_signatures.begin(), type_signatures.end(), signature);
+				return (uint32_t)(type - type_signatures.begin());
+			};
+
 			auto HandleType = [&]() {
+				opt_io.SetItemType(TYPE);
+				bool predicted = IMMEDIATE_PREDICTIONS[last_instruction].type;
 				switch(mode) {
 				case READ_NORMAL: {
 					int32_t type = io.ReadLEB();
+					if(!predicted || type != wasm::BinaryConsts::EncodedType::Empty) {
+						io.huffman.Count<TYPE>(type);
+					}
 					items.push_back(new WasmType { { TYPE }, type });
 					return type;
 				} break;
@@ -685,19 +1470,32 @@ namespace Mni {
 					io.WriteLEB(item->type);
 				} break;
 				case READ_OPTIMIZED: {
-					int32_t type = opt_io.ReadLEB();
+					int32_t type = predicted && opt_io.ReadUNum(1)
+									   ? (int32_t)wasm::BinaryConsts::EncodedType::Empty
+									   : opt_io.ReadCoded<TYPE>();
 					items.push_back(new WasmType { { TYPE }, type });
 					return type;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmType* item = (WasmType*)items[item_idx];
-					opt_io.WriteLEB(item->type);
+					if(predicted) {
+						bool hit = item->type == wasm::BinaryConsts::EncodedType::Empty;
+						opt_io.WriteUNum(hit, 1);
+						if(hit) {
+							break;
+						}
+					}
+					opt_io.WriteCoded<TYPE>(item->type);
 				} break;
 				}
 				return 0;
 			};
 
 			auto HandleIndexedType = [&]() {
+				opt_io.SetItemType(INDEXED_TYPE);
+				// Known imports usually use the first type with their signature
+				uint8_t signature = import_signature;
+				import_signature  = NO_SIGNATURE;
 				switch(mode) {
 				case READ_NORMAL: {
 					uint32_t indexed_type = io.ReadULEB();
@@ -709,12 +1507,21 @@ namespace Mni {
 					io.WriteULEB(item->type);
 				} break;
 				case READ_OPTIMIZED: {
-					uint32_t indexed_type = opt_io.ReadULEB();
+					uint32_t indexed_type = signature != NO_SIGNATURE && opt_io.ReadUNum(1)
+												? FindType(signature)
+												: opt_io.ReadULEB();
 					items.push_back(new WasmIndexedType { { INDEXED_TYPE }, indexed_type });
 					return indexed_type;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmIndexedType* item = (WasmIndexedType*)items[item_idx];
+					if(signature != NO_SIGNATURE) {
+						bool known = FindType(signature) == item->type;
+						opt_io.WriteUNum(known, 1);
+						if(known) {
+							break;
+						}
+					}
 					opt_io.WriteULEB(item->type);
 				} break;
 				}
@@ -727,6 +1534,7 @@ namespace Mni {
 			};
 
 			auto HandleAttribute = [&]() {
+				opt_io.SetItemType(ATTRIBUTE);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t attribute = io.ReadU8();
@@ -750,6 +1558,7 @@ namespace Mni {
 			};
 
 			auto HandleFlags = [&](uint8_t bits) {
+				opt_io.SetItemType(FLAGS);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t flags = io.ReadU8();
@@ -779,10 +1588,15 @@ namespace Mni {
 			};
 
 			auto HandleMemoryOp = [&]() {
+				opt_io.SetItemType(MEMORY_OP);
+				auto& prediction = IMMEDIATE_PREDICTIONS[last_instruction];
 				switch(mode) {
 				case READ_NORMAL: {
 					uint64_t align  = io.ReadULEB();
 					uint64_t offset = io.ReadULEB();
+					if(!prediction.memory_op || align != prediction.align || offset != 0) {
+						io.huffman.Count<MEMORY_OP>(align);
+					}
 					items.push_back(new WasmMemoryOp { { MEMORY_OP }, align, offset });
 				} break;
 				case WRITE_NORMAL: {
@@ -791,73 +1605,152 @@ namespace Mni {
 					io.WriteULEB(item->offset);
 				} break;
 				case READ_OPTIMIZED: {
-					uint64_t align  = opt_io.ReadULEB();
+					if(prediction.memory_op && opt_io.ReadUNum(1)) {
+						items.push_back(new WasmMemoryOp { { MEMORY_OP }, prediction.align, 0 });
+						break;
+					}
+					uint64_t align  = opt_io.ReadCoded<MEMORY_OP>();
 					uint64_t offset = opt_io.ReadULEB();
 					items.push_back(new WasmMemoryOp { { MEMORY_OP }, align, offset });
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmMemoryOp* item = (WasmMemoryOp*)items[item_idx];
-					opt_io.WriteULEB(item->align);
+					if(prediction.memory_op) {
+						bool hit = item->align == prediction.align && item->offset == 0;
+						opt_io.WriteUNum(hit, 1);
+						if(hit) {
+							break;
+						}
+					}
+					opt_io.WriteCoded<MEMORY_OP>(item->align);
 					opt_io.WriteULEB(item->offset);
 				} break;
 				}
 			};
 
-			uint8_t last_instruction = wasm::BinaryConsts::Unreachable;
-			auto HandleInstruction   = [&]() {
+			// Blocks open in the current expression, innermost last
+			// Instructions inside a block are coded with their own table when it pays for
+			// itself, so end is modeled by depth and else only takes up codes where it can appear
+			std::vector<uint8_t> control;
+			// Exception handling opcode not named by this version of Binaryen
+			constexpr uint8_t TRY_TABLE = 0x1f;
+			auto UsesBlockTable = [&]() {
+				auto& table = opt_io.huffman.Get<BLOCK_OPCODE>();
+				return !control.empty()
+					   && (mode == READ_NORMAL || (mode == READ_OPTIMIZED ? table.tree : table.rep));
+			};
+
+			// Normal bytes left in the function body being coded, while structured its final
+			// end is left out since it is the only instruction that fits in the last byte
+			int64_t body_left   = -1;
+			size_t body_counted = 0;
+			// Position after the body while reading normal webassembly
+			size_t body_end = 0;
+			auto StartBody  = [&](size_t size_item) {
+				body_left    = ((WasmSize*)items[size_item])->size;
+				body_counted = size_item + 1;
+			};
+			// Whether the instruction at item index next is the final end of the body
+			auto AtFinalEnd = [&](size_t next) {
+				if(body_left < 0) {
+					return false;
+				}
+				for(; body_counted < next; body_counted++) {
+					body_left -= NormalSize(items[body_counted]);
+				}
+				if(body_left != 1) {
+					return false;
+				}
+				body_left = -1;
+				return true;
+			};
+			auto UpdateControl = [&](uint8_t code) {
+				last_instruction = code;
+				switch(code) {
+				case wasm::BinaryConsts::Block:
+				case wasm::BinaryConsts::Loop:
+				case wasm::BinaryConsts::If:
+				case wasm::BinaryConsts::Try:
+				case TRY_TABLE:
+					control.push_back(code);
+					break;
+				case wasm::BinaryConsts::Else:
+				case wasm::BinaryConsts::Catch:
+				case wasm::BinaryConsts::CatchAll:
+					if(!control.empty()) {
+						control.back() = code;
+					}
+					break;
+				case wasm::BinaryConsts::End:
+				case wasm::BinaryConsts::Delegate:
+					// Ending the expression itself leaves the stack empty
+					if(!control.empty()) {
+						control.pop_back();
+					}
+					break;
+				}
+			};
+
+			auto HandleInstruction = [&]() {
+                opt_io.SetItemType(INSTRUCTION);
+                bool nested = UsesBlockTable();
                 switch(mode) {
                 case READ_NORMAL: {
                     uint8_t code = io.ReadU8();
-
-                    // Construct huffman frequencies
-                    if(io.huffman.INSTRUCTION_construct) {
-                        if(io.huffman.INSTRUCTION_frequencies.count(code)) {
-                            io.huffman.INSTRUCTION_frequencies[code].freq++;
-                        } else {
-                            io.huffman.INSTRUCTION_frequencies[code] = Tree::Node(code, 1);
-                        }
+                    if(code == wasm::BinaryConsts::End && io.GetPos() == body_end) {
+                        // Never coded while structured, counted later otherwise
+                        body_end = 0;
+                    } else if(nested) {
+                        io.huffman.Count<BLOCK_OPCODE>(code);
+                    } else {
+                        io.huffman.Count<INSTRUCTION>(code);
                     }
 
+                    opt_io.TraceValue(code);
                     items.push_back(new WasmInstruction { { INSTRUCTION }, code });
-                    last_instruction = code;
+                    UpdateControl(code);
                     return code;
                 } break;
                 case WRITE_NORMAL: {
                     WasmInstruction* item = (WasmInstruction*)items[item_idx];
                     io.WriteU8(item->node);
+                    UpdateControl(item->node);
                 } break;
                 case READ_OPTIMIZED: {
                     uint8_t code;
-                    // Read from huffman tree if it exists
-                    if(opt_io.huffman.INSTRUCTION_tree) {
-                        opt_io.ReadHuffmanValue(opt_io.huffman.INSTRUCTION_root, &code);
+                    if(opt_io.IsStructured() && AtFinalEnd(items.size())) {
+                        code = wasm::BinaryConsts::End;
                     } else {
-                        code = opt_io.ReadUNum(8);
+                        code = nested ? opt_io.ReadCoded<BLOCK_OPCODE>()
+                                      : opt_io.ReadCoded<INSTRUCTION>();
                     }
 
+                    opt_io.TraceValue(code);
                     items.push_back(new WasmInstruction { { INSTRUCTION }, code });
-                    last_instruction = code;
+                    UpdateControl(code);
                     return code;
                 } break;
                 case WRITE_OPTIMIZED: {
                     WasmInstruction* item = (WasmInstruction*)items[item_idx];
-
-                    // Use huffman trees constructed earlier
-                    if(io.huffman.INSTRUCTION_rep) {
-                        auto& rep = io.huffman.INSTRUCTION_rep_map[item->node];
-                        opt_io.WriteUNum(rep.representation, rep.bit_size);
+                    if(opt_io.IsStructured() && AtFinalEnd(item_idx)) {
+                        // Placed by the decoder
+                    } else if(nested) {
+                        opt_io.WriteCoded<BLOCK_OPCODE>(item->node);
                     } else {
-                        opt_io.WriteUNum(item->node, 8);
+                        opt_io.WriteCoded<INSTRUCTION>(item->node);
                     }
+                    UpdateControl(item->node);
                 } break;
                 }
                 return (uint8_t)0;
 			};
 
 			auto HandleBreak = [&]() {
+				opt_io.SetItemType(BREAK);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint32_t break_offset = io.ReadULEB();
+					io.huffman.Count<BREAK>(break_offset);
 					items.push_back(new WasmBreak { { BREAK }, break_offset });
 					return break_offset;
 				} break;
@@ -866,19 +1759,20 @@ namespace Mni {
 					io.WriteULEB(item->offset);
 				} break;
 				case READ_OPTIMIZED: {
-					uint32_t break_offset = opt_io.ReadULEB();
+					uint32_t break_offset = opt_io.ReadCoded<BREAK>();
 					items.push_back(new WasmBreak { { BREAK }, break_offset });
 					return break_offset;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmBreak* item = (WasmBreak*)items[item_idx];
-					opt_io.WriteULEB(item->offset);
+					opt_io.WriteCoded<BREAK>(item->offset);
 				} break;
 				}
 				return (uint32_t)0;
 			};
 
 			auto HandleNum = [&]() {
+				opt_io.SetItemType(NUM);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint32_t num = io.ReadULEB();
@@ -891,6 +1785,11 @@ namespace Mni {
 				} break;
 				case READ_OPTIMIZED: {
 					uint32_t num = opt_io.ReadULEB();
+					if(num > opt_io.ItemsLeft()) {
+						// Every counted entry is at least one item
+						opt_io.Fail();
+						num = 0;
+					}
 					items.push_back(new WasmNumber { { NUM }, num });
 					return num;
 				} break;
@@ -902,31 +1801,113 @@ namespace Mni {
 				return (uint32_t)0;
 			};
 
-			auto HandleIndex = [&](WasmItemType type) {
+			// Function types with a known signature are written as its index
+			auto HandleFunctionType = [&]() {
+				opt_io.SetItemType(TYPE);
 				switch(mode) {
-				case READ_NORMAL: {
-					uint32_t idx = io.ReadULEB();
-					items.push_back(new WasmIndex { { type }, idx });
-					return idx;
-				} break;
+				case WRITE_NORMAL:
+					// Written item by item
+					HandleType();
+					return;
+				case READ_OPTIMIZED: {
+					if(!opt_io.ReadUNum(1)) {
+						break;
+					}
+					uint8_t id = opt_io.ReadUNum(SIGNATURE_BITS);
+					if(id >= std::size(KNOWN_SIGNATURES)) {
+						// Structure is kept with the first signature, the decode fails
+						opt_io.Fail();
+						id = 0;
+					}
+					auto& signature = KNOWN_SIGNATURES[id];
+					items.push_back(new WasmType { { TYPE }, wasm::BinaryConsts::EncodedType::Func });
+					items.push_back(new WasmNumber { { NUM }, signature.num_params });
+					for(uint8_t j = 0; j < signature.num_params; j++) {
+						items.push_back(new WasmType { { TYPE }, signature.params[j] });
+					}
+					items.push_back(new WasmNumber { { NUM }, signature.num_results });
+					if(signature.num_results) {
+						items.push_back(new WasmType { { TYPE }, signature.result });
+					}
+					type_signatures.push_back(id);
+					return;
+				}
+				case WRITE_OPTIMIZED: {
+					uint8_t id = MatchSignature(items, item_idx);
+					type_signatures.push_back(id);
+					opt_io.WriteUNum(id != NO_SIGNATURE, 1);
+					if(id == NO_SIGNATURE) {
+						// Rest of the type is written item by item
+						HandleType();
+						return;
+					}
+					opt_io.WriteUNum(id, SIGNATURE_BITS);
+					// Continue after the last item of the type
+					auto& signature = KNOWN_SIGNATURES[id];
+					item_idx += 2 + signature.num_params + signature.num_results;
+					return;
+				}
+				default:
+					break;
+				}
+
+				size_t start = items.size();
+				int32_t type = HandleType();
+				if(type == wasm::BinaryConsts::EncodedType::Func) {
+					uint32_t num_params = HandleNum();
+					for(uint32_t j = 0; j < num_params; j++) {
+						int32_t param_type = HandleType();
+					}
+
+					uint32_t num_results = HandleNum();
+					for(uint32_t j = 0; j < num_results; j++) {
+						int32_t result_type = HandleType();
+					}
+				}
+				type_signatures.push_back(MatchSignature(items, start));
+			};
+
+			auto HandleIndex = [&](WasmItemType type) {
+				opt_io.SetItemType(type);
+				import_signature = NO_SIGNATURE;
+				switch(mode) {
+				case READ_NORMAL: {
+					uint32_t idx = io.ReadULEB();
+					switch(type) {
+					case FUNCTION:
+						io.huffman.Count<FUNCTION>(idx);
+						break;
+					case LOCAL:
+						io.huffman.Count<LOCAL>(idx);
+						break;
+					case GLOBAL:
+						io.huffman.Count<GLOBAL>(idx);
+						break;
+					default:
+						break;
+					}
+					items.push_back(new WasmIndex { { type }, idx });
+					return idx;
+				} break;
 				case WRITE_NORMAL: {
 					WasmIndex* item = (WasmIndex*)items[item_idx];
 					io.WriteULEB(item->index);
 				} break;
 				case READ_OPTIMIZED: {
-					uint32_t idx = opt_io.ReadULEB();
+					uint32_t idx = opt_io.ReadIndex(type);
 					items.push_back(new WasmIndex { { type }, idx });
 					return idx;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmIndex* item = (WasmIndex*)items[item_idx];
-					opt_io.WriteULEB(item->index);
+					opt_io.WriteIndex(item->type, item->index);
 				} break;
 				}
 				return (uint32_t)0;
 			};
 
 			auto HandleI32 = [&]() {
+				opt_io.SetItemType(I32);
 				switch(mode) {
 				case READ_NORMAL: {
 					int32_t literal = io.ReadLEB();
@@ -951,6 +1932,7 @@ namespace Mni {
 			};
 
 			auto HandleI64 = [&]() {
+				opt_io.SetItemType(I64);
 				switch(mode) {
 				case READ_NORMAL: {
 					int64_t literal = io.ReadLEB();
@@ -975,6 +1957,7 @@ namespace Mni {
 			};
 
 			auto HandleF32 = [&]() {
+				opt_io.SetItemType(F32);
 				switch(mode) {
 				case READ_NORMAL: {
 					float literal = io.ReadFloat32();
@@ -999,6 +1982,7 @@ namespace Mni {
 			};
 
 			auto HandleF64 = [&]() {
+				opt_io.SetItemType(F64);
 				switch(mode) {
 				case READ_NORMAL: {
 					double literal = io.ReadFloat64();
@@ -1023,9 +2007,11 @@ namespace Mni {
 			};
 
 			auto HandleInstruction32 = [&]() {
+				opt_io.SetItemType(INSTRUCTION32);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint32_t code = io.ReadULEB();
+					io.huffman.Count<INSTRUCTION32>(code);
 					items.push_back(new WasmInstruction32 { { INSTRUCTION32 }, code });
 					return code;
 				} break;
@@ -1034,19 +2020,20 @@ namespace Mni {
 					io.WriteULEB(item->node);
 				} break;
 				case READ_OPTIMIZED: {
-					uint32_t code = opt_io.ReadULEB();
+					uint32_t code = opt_io.ReadCoded<INSTRUCTION32>();
 					items.push_back(new WasmInstruction32 { { INSTRUCTION32 }, code });
 					return code;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmInstruction32* item = (WasmInstruction32*)items[item_idx];
-					opt_io.WriteULEB(item->node);
+					opt_io.WriteCoded<INSTRUCTION32>(item->node);
 				} break;
 				}
 				return (uint32_t)0;
 			};
 
 			auto HandleAtomicOrder = [&]() {
+				opt_io.SetItemType(ATOMIC_ORDER);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t order = io.ReadULEB();
@@ -1071,6 +2058,7 @@ namespace Mni {
 			};
 
 			auto HandleSegment = [&]() {
+				opt_io.SetItemType(SEGMENT);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint32_t segment_idx = io.ReadULEB();
@@ -1095,6 +2083,7 @@ namespace Mni {
 			};
 
 			auto HandleMemory = [&]() {
+				opt_io.SetItemType(MEMORY_IDX);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t memory_idx = io.ReadU8();
@@ -1118,6 +2107,7 @@ namespace Mni {
 			};
 
 			auto HandleV128 = [&]() {
+				opt_io.SetItemType(I128);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint64_t lower = io.ReadU8() | (io.ReadU8() << 8) | (io.ReadU8() << 16)
@@ -1149,6 +2139,7 @@ namespace Mni {
 			};
 
 			auto HandleLane = [&]() {
+				opt_io.SetItemType(LANE);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t lane = io.ReadU8();
@@ -1173,6 +2164,7 @@ namespace Mni {
 			};
 
 			auto HandleSize = [&]() {
+				opt_io.SetItemType(SIZE);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint32_t size = io.ReadULEB();
@@ -1201,10 +2193,12 @@ namespace Mni {
 				size_t len;
 			};
 			auto HandleSection = [&]() {
+				opt_io.SetItemType(SECTION);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t section_id = io.ReadU8();
 					size_t section_len = io.ReadULEB();
+					opt_io.TraceSection(section_id);
 					// Ignore user section for now
 					if(section_id != wasm::BinaryConsts::Section::User) {
 						items.push_back(new WasmSection { { SECTION }, section_id, section_len });
@@ -1219,11 +2213,13 @@ namespace Mni {
 				case READ_OPTIMIZED: {
 					uint8_t section_id = opt_io.ReadUNum(5);
 					size_t section_len = opt_io.ReadULEB();
+					opt_io.TraceSection(section_id);
 					items.push_back(new WasmSection { { SECTION }, section_id, section_len });
 					return Section { section_id, section_len };
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmSection* item = (WasmSection*)items[item_idx];
+					opt_io.TraceSection(item->id);
 					opt_io.WriteUNum(item->id, 5);
 					opt_io.WriteULEB(item->size);
 				} break;
@@ -1231,11 +2227,25 @@ namespace Mni {
 				return Section { 0, 0 };
 			};
 
+			// Count the literals left after LZ compression
+			auto CountLiterals = [&](std::span<const uint8_t> data) {
+				for(auto& token : Mni::Lz::Parse(data, opt_io.GetDictionary())) {
+					if(token.type == Mni::Lz::LITERAL) {
+						io.huffman.Count<DATA>(token.literal);
+					}
+				}
+			};
+
 			auto HandleString = [&]() {
+				opt_io.SetItemType(STRING);
 				switch(mode) {
 				case READ_NORMAL: {
-					std::string str = io.ReadString();
-					items.push_back(new WasmString { { STRING }, str });
+					auto str   = io.ReadStringView();
+					known_name = DEFINED_FUNCTIONS.Find(str);
+					if(io.huffman.Get<DATA>().construct && known_name == -1) {
+						CountLiterals({ (const uint8_t*)str.data(), str.size() });
+					}
+					items.push_back(NewString(str));
 					return str;
 				} break;
 				case WRITE_NORMAL: {
@@ -1244,49 +2254,62 @@ namespace Mni {
 				} break;
 				case READ_OPTIMIZED: {
 					bool known_function_name = opt_io.ReadUNum(1);
+					known_name               = -1;
 					if(known_function_name) {
 						// Known function name for this runtime
 						uint32_t id = opt_io.ReadULEB();
-						if(Mni::Wasm::DEFINED_FUNCTIONS.contains(id)) {
-							auto str = Mni::Wasm::DEFINED_FUNCTIONS.at(id);
-							items.push_back(new WasmString { { STRING }, str });
-							return str;
-						} else {
-							// Invalid parsing TODO
+						if(!DEFINED_FUNCTIONS.Contains(id)) {
+							opt_io.Fail();
+							items.push_back(NewString(std::string_view()));
+							return std::string_view();
 						}
+						known_name = id;
+						// Names of the runtime are static, so they can be referenced
+						std::string_view str = DEFINED_FUNCTIONS.Name(id);
+						items.push_back(NewString(str));
+						return str;
 					} else {
 						size_t string_size = opt_io.ReadULEB();
 
-						std::string str
-							= string_size == 0 ? std::string() : opt_io.ReadString(string_size);
-						items.push_back(new WasmString { { STRING }, str });
-						return str;
+						auto data = opt_io.ReadData(string_size);
+						auto item = NewString(std::string(data.begin(), data.end()));
+						items.push_back(item);
+						return item->str;
 					}
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmString* item = (WasmString*)items[item_idx];
 
 					// Check if this string matches known function name
-					if(Mni::Wasm::REVERSE_DEFINED_FUNCTIONS.contains(item->str)) {
+					known_name = DEFINED_FUNCTIONS.Find(item->str);
+					if(known_name != -1) {
 						opt_io.WriteUNum(1, 1);
-						opt_io.WriteULEB(Mni::Wasm::REVERSE_DEFINED_FUNCTIONS.at(item->str));
+						opt_io.WriteULEB(known_name);
 					} else {
 						opt_io.WriteUNum(0, 1);
 						opt_io.WriteULEB(item->str.size());
-						if(item->str.size() != 0) {
-							opt_io.WriteString(item->str);
-						}
+						opt_io.WriteData({ (const uint8_t*)item->str.data(), item->str.size() });
 					}
 				} break;
 				}
-				return std::string();
+				return std::string_view();
+			};
+
+			// A function named after a known function has its signature, unless this is an export
+			auto ExpectSignature = [&](uint8_t external) {
+				import_signature
+					= external == (uint8_t)wasm::ExternalKind::Function && known_name != -1
+						  ? FUNCTION_SIGNATURES[known_name]
+						  : NO_SIGNATURE;
 			};
 
 			auto HandleExternal = [&]() {
+				opt_io.SetItemType(EXTERNAL);
 				switch(mode) {
 				case READ_NORMAL: {
 					uint8_t external = io.ReadU8();
 					items.push_back(new WasmExternal { { EXTERNAL }, external });
+					ExpectSignature(external);
 					return external;
 				} break;
 				case WRITE_NORMAL: {
@@ -1296,21 +2319,27 @@ namespace Mni {
 				case READ_OPTIMIZED: {
 					uint8_t external = opt_io.ReadUNum(4);
 					items.push_back(new WasmExternal { { EXTERNAL }, external });
+					ExpectSignature(external);
 					return external;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmExternal* item = (WasmExternal*)items[item_idx];
 					opt_io.WriteUNum(item->external, 4);
+					ExpectSignature(item->external);
 				} break;
 				}
 				return (uint8_t)0;
 			};
 
 			auto HandleSlice = [&](size_t size) {
+				opt_io.SetItemType(DATA);
 				switch(mode) {
 				case READ_NORMAL: {
-					auto slice = size == 0 ? std::vector<uint8_t>() : io.ReadSlice(size);
-					items.push_back(new WasmData { { DATA }, slice });
+					auto slice = io.ReadSliceView(size);
+					if(io.huffman.Get<DATA>().construct) {
+						CountLiterals(slice);
+					}
+					items.push_back(NewData(slice));
 					return slice;
 				} break;
 				case WRITE_NORMAL: {
@@ -1320,24 +2349,28 @@ namespace Mni {
 					}
 				} break;
 				case READ_OPTIMIZED: {
-					auto slice = size == 0 ? std::vector<uint8_t>() : opt_io.ReadSlice(size);
-					items.push_back(new WasmData { { DATA }, slice });
-					return slice;
+					auto item = NewData(opt_io.ReadData(size));
+					items.push_back(item);
+					return item->data;
 				} break;
 				case WRITE_OPTIMIZED: {
 					WasmData* item = (WasmData*)items[item_idx];
-					if(item->data.size() != 0) {
-						opt_io.WriteSlice(item->data);
-					}
+					opt_io.WriteData(item->data);
 				} break;
 				}
-				return std::vector<uint8_t>();
+				return std::span<const uint8_t>();
 			};
 
 			std::function<void()> HandleInstructions = [&]() {
-				while(true) {
+				// Damaged streams could nest blocks until the stack runs out
+				if(mode == READ_OPTIMIZED && control.size() > MAX_BLOCK_DEPTH) {
+					opt_io.Fail();
+				}
+				while(!opt_io.Failed()) {
 					uint8_t code = HandleInstruction();
-					if(code == wasm::BinaryConsts::End || code == wasm::BinaryConsts::Else) {
+					if(code == wasm::BinaryConsts::End || code == wasm::BinaryConsts::Else
+						|| code == wasm::BinaryConsts::Catch || code == wasm::BinaryConsts::CatchAll
+						|| code == wasm::BinaryConsts::Delegate) {
 						return;
 					} else {
 						switch(code) {
@@ -1353,6 +2386,41 @@ namespace Mni {
 								HandleInstructions();
 							}
 							break;
+						case wasm::BinaryConsts::Try:
+							HandleType();
+							HandleInstructions();
+							while(!opt_io.Failed()
+								  && (last_instruction == wasm::BinaryConsts::Catch
+									  || last_instruction == wasm::BinaryConsts::CatchAll)) {
+								if(last_instruction == wasm::BinaryConsts::Catch) {
+									HandleIndex(TAG);
+								}
+								HandleInstructions();
+							}
+							// Delegate ends the try in place of end
+							if(last_instruction == wasm::BinaryConsts::Delegate) {
+								HandleBreak();
+							}
+							break;
+						case TRY_TABLE: {
+							HandleType();
+							uint32_t num_catches = HandleNum();
+							for(uint32_t i = 0; i < num_catches; i++) {
+								// catch, catch_ref, catch_all and catch_all_ref
+								uint8_t kind = HandleFlags(2);
+								if(kind < 2) {
+									HandleIndex(TAG);
+								}
+								HandleBreak();
+							}
+							HandleInstructions();
+						} break;
+						case wasm::BinaryConsts::Throw: {
+							HandleIndex(TAG);
+						} break;
+						case wasm::BinaryConsts::Rethrow: {
+							HandleBreak();
+						} break;
 						case wasm::BinaryConsts::Br:
 						case wasm::BinaryConsts::BrIf: {
 							HandleBreak();
@@ -1600,7 +2668,316 @@ namespace Mni {
 				}
 			};
 
+			// Bodies encoded in parallel are appended as they are
+			auto HandleEncoded = [&](WasmEncoded& body) {
+				opt_io.SetItemType(ENCODED);
+				opt_io.WriteBits(body.bytes, body.bits);
+			};
+
+			auto HandleItem = [&](WasmItem* item) {
+				switch(item->type) {
+				case NUM:
+					HandleNum();
+					break;
+				case SIZE:
+					HandleSize();
+					break;
+				case SECTION:
+					HandleSection();
+					break;
+				case STRING:
+					HandleString();
+					break;
+				case TYPE:
+					if(((WasmType*)item)->type == wasm::BinaryConsts::EncodedType::Func) {
+						HandleFunctionType();
+					} else {
+						HandleType();
+					}
+					break;
+				case INDEXED_TYPE:
+					HandleIndexedType();
+					break;
+				case LIMIT:
+					HandleLimits();
+					break;
+				case MEMORY_OP:
+					HandleMemoryOp();
+					break;
+				case INSTRUCTION:
+					HandleInstruction();
+					break;
+				case INSTRUCTION32:
+					HandleInstruction32();
+					break;
+				case BLOCK_OPCODE:
+					// Instructions are always stored as INSTRUCTION
+					break;
+				case ATTRIBUTE:
+					HandleAttribute();
+					break;
+				case BREAK:
+					HandleBreak();
+					break;
+				case FUNCTION:
+				case TABLE:
+				case LOCAL:
+				case GLOBAL:
+				case MEMORY:
+				case TAG:
+				case STRUCT:
+					HandleIndex(item->type);
+					break;
+				case I32:
+					HandleI32();
+					break;
+				case I64:
+					HandleI64();
+					break;
+				case I128:
+					HandleV128();
+					break;
+				case F32:
+					HandleF32();
+					break;
+				case F64:
+					HandleF64();
+					break;
+				case ATOMIC_ORDER:
+					HandleAtomicOrder();
+					break;
+				case SEGMENT:
+					HandleSegment();
+					break;
+				case MEMORY_IDX:
+					HandleMemory();
+					break;
+				case LANE:
+					HandleLane();
+					break;
+				case EXTERNAL:
+					HandleExternal();
+					break;
+				case FLAGS:
+					HandleFlags(0);
+					break;
+				case DATA:
+					HandleSlice(0);
+					break;
+				case ENCODED:
+					// Only written through HandleEncoded
+					break;
+				}
+			};
+
+			auto HandleFunctionBody = [&]() {
+				uint32_t size = HandleSize();
+				StartBody(items.size() - 1);
+				if(mode == READ_NORMAL) {
+					body_end = io.GetPos() + size;
+				}
+				uint32_t num_local_types = HandleNum();
+				for(int j = 0; j < num_local_types; j++) {
+					uint32_t num_locals = HandleNum();
+					HandleType();
+				}
+
+				HandleInstructions();
+			};
+
+			// Bodies are independent given the huffman trees, so decode them in parallel and
+			// keep every body as already encoded normal webassembly
+			auto HandleIndexedFunctionBodies = [&](uint32_t num_funcs) {
+				auto& starts = opt_io.GetFunctionStarts();
+				if(starts.size() != num_funcs + 1 || starts[0] != opt_io.GetCurrentBit()) {
+					return false;
+				}
+
+				std::vector<std::vector<uint8_t>> bodies(num_funcs);
+				std::vector<uint64_t> ends(num_funcs);
+				Mni::Parallel::For(num_funcs, [&](size_t i) {
+					ends[i] = DecodeFunctionBody(opt_io, starts[i], starts[i + 1], bodies[i]);
+				});
+				for(uint32_t i = 0; i < num_funcs; i++) {
+					if(ends[i] != starts[i + 1]) {
+						opt_io.Fail();
+					}
+				}
+
+				for(auto& body : bodies) {
+					items.push_back(NewData(std::move(body)));
+				}
+				opt_io.SetCurrentBit(starts[num_funcs]);
+				return true;
+			};
+
+			auto IsInstruction = [&](size_t i, uint8_t code) {
+				return i < items.size() && items[i]->type == INSTRUCTION
+					   && ((WasmInstruction*)items[i])->node == code;
+			};
+			auto IsI32Const = [&](size_t i) {
+				return IsInstruction(i, wasm::BinaryConsts::I32Const) && i + 1 < items.size()
+					   && items[i + 1]->type == I32;
+			};
+			auto GetI32 = [&](size_t i) { return ((WasmI32*)items[i + 1])->literal; };
+
+			auto FillMetadata = [&]() {
+				Metadata& meta = opt_io.GetMetadata();
+				meta           = Metadata {};
+				meta.imports.assign(imported_functions.begin(), imported_functions.end());
+
+				// Runtime functions in id order, the rest sorted so the block is deterministic
+				std::vector<std::string_view> other_exports;
+				for(uint32_t id = 0; id < DEFINED_FUNCTIONS.names.size(); id++) {
+					if(exported_functions.contains(DEFINED_FUNCTIONS.Name(id))) {
+						meta.exports.push_back(std::string(DEFINED_FUNCTIONS.Name(id)));
+					}
+				}
+				for(auto& [name, index] : exported_functions) {
+					if(DEFINED_FUNCTIONS.Find(name) == -1) {
+						other_exports.push_back(name);
+					}
+				}
+				std::sort(other_exports.begin(), other_exports.end());
+				meta.exports.insert(meta.exports.end(), other_exports.begin(), other_exports.end());
+
+				for(auto item : items) {
+					if(item->type == INSTRUCTION) {
+						switch(((WasmInstruction*)item)->node) {
+						case wasm::BinaryConsts::MiscPrefix:
+							meta.features |= FEATURE_MISC;
+							break;
+						case wasm::BinaryConsts::SIMDPrefix:
+							meta.features |= FEATURE_SIMD;
+							break;
+						case wasm::BinaryConsts::AtomicPrefix:
+							meta.features |= FEATURE_ATOMICS;
+							break;
+						case wasm::BinaryConsts::GCPrefix:
+							meta.features |= FEATURE_GC;
+							break;
+						}
+					}
+				}
+
+				// Range of the code of an exported function, after the locals
+				auto FindCode = [&](std::string_view name, size_t& start, size_t& end) {
+					if(!exported_functions.contains(name)
+						|| exported_functions[name] < imported_functions.size()) {
+						return false;
+					}
+					uint32_t defined = exported_functions[name] - imported_functions.size();
+					if(!body_items.contains(defined)) {
+						return false;
+					}
+					start = body_items[defined].first;
+					end   = body_items[defined].second;
+					while(start < end && items[start]->type != INSTRUCTION) {
+						start++;
+					}
+					return true;
+				};
+
+				size_t start, end;
+				// mni_name returns a pointer to a null terminated string in a data segment
+				if(FindCode("mni_name", start, end) && IsI32Const(start)) {
+					int32_t address = GetI32(start);
+					for(auto& [offset, data_item] : active_segments) {
+						auto& data = ((WasmData*)items[data_item])->data;
+						if(address >= offset && address < offset + (int64_t)data.size()) {
+							auto name_start = data.begin() + (address - offset);
+							meta.name = std::string(name_start, std::find(name_start, data.end(), 0));
+							break;
+						}
+					}
+				}
+
+				// First mni_set_bounds(i32.const, i32.const) in mni_prepare
+				if(FindCode("mni_prepare", start, end)) {
+					for(size_t i = start; i + 5 < end; i++) {
+						if(IsI32Const(i) && IsI32Const(i + 2)
+							&& IsInstruction(i + 4, wasm::BinaryConsts::CallFunction)
+							&& items[i + 5]->type == FUNCTION) {
+							uint32_t function = ((WasmIndex*)items[i + 5])->index;
+							if(function < imported_functions.size()
+								&& imported_functions[function] == "mni_set_bounds") {
+								meta.width  = GetI32(i);
+								meta.height = GetI32(i + 2);
+								break;
+							}
+						}
+					}
+				}
+			};
+
+			// Bodies are parsed in parallel, each counting into its own huffman registry
+			auto HandleParallelFunctionBodies = [&](uint32_t num_funcs) {
+				std::vector<size_t> starts;
+				for(uint32_t i = 0; i < num_funcs; i++) {
+					starts.push_back(io.GetPos());
+					uint32_t size = io.ReadULEB();
+					io.Skip(size);
+				}
+
+				std::vector<ParsedWasm> bodies(num_funcs);
+				std::vector<Huffman> frequencies(num_funcs);
+				Mni::Parallel::For(num_funcs, [&](size_t i) {
+					frequencies[i].SetConstruct(true);
+					IO body_io(io.GetBytes(), frequencies[i]);
+					body_io.Skip(starts[i]);
+					std::vector<uint8_t> unused;
+					OptimizedIO body_opt_io(unused, 0, frequencies[i]);
+					ConvertWasm(READ_NORMAL, NONE, body_io, body_opt_io, SCOPE_FUNCTION_BODY,
+						false, &bodies[i]);
+				});
+
+				for(uint32_t i = 0; i < num_funcs; i++) {
+					io.huffman.Merge(frequencies[i]);
+					function_items.push_back(items.size());
+					items.insert(items.end(), bodies[i].items.begin(), bodies[i].items.end());
+					bodies[i].items.clear();
+					if(extract_metadata) {
+						body_items[i] = { function_items.back(), items.size() };
+					}
+				}
+			};
+
+			// Encode every body on its own, the huffman tables must be final
+			auto EncodeParallelFunctionBodies = [&]() {
+				std::vector<WasmEncoded> encoded;
+				if(function_items.size() < 2) {
+					return encoded;
+				}
+
+				encoded.resize(function_items.size() - 1);
+				Mni::Parallel::For(encoded.size(), [&](size_t i) {
+					ParsedWasm body;
+					body.items.assign(items.begin() + function_items[i],
+						items.begin() + function_items[i + 1]);
+					body.owns_items = false;
+					OptimizedIO body_opt_io(encoded[i].bytes, 0, opt_io.huffman);
+					body_opt_io.SetStructured(opt_io.IsStructured());
+					ConvertWasm(NONE, WRITE_OPTIMIZED, io, body_opt_io, SCOPE_FUNCTION_BODY, false,
+						&body);
+					encoded[i].bits = body_opt_io.GetCurrentBit();
+				});
+				return encoded;
+			};
+
 			auto HandleReadOrWrite = [&]() {
+				type_signatures.clear();
+				if(scope == SCOPE_FUNCTION_BODY) {
+					if(mode == READ_NORMAL || mode == READ_OPTIMIZED) {
+						HandleFunctionBody();
+					} else {
+						StartBody(0);
+						for(item_idx = 0; item_idx < items.size(); item_idx++) {
+							HandleItem(items[item_idx]);
+						}
+					}
+					return;
+				}
+
 				if(mode == READ_NORMAL || mode == READ_OPTIMIZED) {
 					if(mode == READ_NORMAL) {
 						uint32_t magic   = io.ReadU32();
@@ -1608,17 +2985,11 @@ namespace Mni {
 					}
 
 					if(mode == READ_OPTIMIZED) {
-						opt_io.ReadSize();
-
 						// Read header information
-						if(opt_io.ReadUNum(1)) {
-							// Huffman tree for INSTRUCTION is included
-							opt_io.huffman.INSTRUCTION_tree = true;
-							opt_io.ReadHuffmanHeader(opt_io.huffman.INSTRUCTION_root);
-						}
+						ReadOptimizedHeader(opt_io);
 					}
 
-					while(mode == READ_NORMAL ? !io.Done() : !opt_io.Done()) {
+					while(mode == READ_NORMAL ? !io.Done() : !opt_io.Done() && !opt_io.Failed()) {
 						auto section       = HandleSection();
 						uint8_t section_id = section.id;
 						size_t section_len = section.len;
@@ -1632,31 +3003,20 @@ namespace Mni {
 						case wasm::BinaryConsts::Section::Type: {
 							uint32_t num_types = HandleNum();
 							for(uint32_t i = 0; i < num_types; i++) {
-								int32_t type = HandleType();
-
-								if(type == wasm::BinaryConsts::EncodedType::Func) {
-									uint32_t num_params = HandleNum();
-									for(uint32_t j = 0; j < num_params; j++) {
-										int32_t param_type = HandleType();
-									}
-
-									uint32_t num_results = HandleNum();
-									for(uint32_t j = 0; j < num_results; j++) {
-										int32_t result_type = HandleType();
-									}
-								}
+								HandleFunctionType();
 							}
 							break;
 						}
 						case wasm::BinaryConsts::Section::Import: {
 							uint32_t num_imports = HandleNum();
 							for(uint32_t i = 0; i < num_imports; i++) {
-								std::string module  = HandleString();
-								std::string name    = HandleString();
+								auto module         = HandleString();
+								auto name           = HandleString();
 								uint8_t import_type = HandleExternal();
 
 								switch((wasm::ExternalKind)import_type) {
 								case wasm::ExternalKind::Function: {
+									imported_functions.push_back(name);
 									HandleIndexedType();
 								} break;
 								case wasm::ExternalKind::Table: {
@@ -1707,18 +3067,20 @@ namespace Mni {
 						case wasm::BinaryConsts::Section::Export: {
 							uint32_t num_exports = HandleNum();
 							for(uint32_t i = 0; i < num_exports; i++) {
-								std::string name    = HandleString();
+								auto name           = HandleString();
 								uint8_t export_type = HandleExternal();
 
 								switch((wasm::ExternalKind)export_type) {
 								case wasm::ExternalKind::Function: {
-									HandleIndex(FUNCTION);
+									exported_functions[name] = HandleIndex(FUNCTION);
 								} break;
 								case wasm::ExternalKind::Table: {
 									HandleIndex(TABLE);
 								} break;
 								case wasm::ExternalKind::Memory: {
-									HandleIndex(MEMORY);
+									uint32_t memory = HandleIndex(MEMORY);
+									exports_memory |= memory == 0;
+									exports_other_memory |= memory != 0;
 								} break;
 								case wasm::ExternalKind::Global: {
 									HandleIndex(GLOBAL);
@@ -1731,6 +3093,7 @@ namespace Mni {
 							break;
 						}
 						case wasm::BinaryConsts::Section::Start: {
+							has_start = true;
 							HandleIndex(FUNCTION);
 							break;
 						}
@@ -1750,29 +3113,49 @@ namespace Mni {
 						}
 						case wasm::BinaryConsts::Section::Code: {
 							uint32_t num_funcs = HandleNum();
-							for(uint32_t i = 0; i < num_funcs; i++) {
-								uint32_t size            = HandleSize();
-								uint32_t num_local_types = HandleNum();
-								for(int j = 0; j < num_local_types; j++) {
-									uint32_t num_locals = HandleNum();
-									HandleType();
-								}
+							// Bodies decoded on their own are not traced
+							if(mode == READ_OPTIMIZED && opt_io.HasFunctionIndex()
+								&& !opt_io.IsTracing() && HandleIndexedFunctionBodies(num_funcs)) {
+								break;
+							}
 
-								HandleInstructions();
+							if(mode == READ_NORMAL && parallel) {
+								HandleParallelFunctionBodies(num_funcs);
+							} else {
+								for(uint32_t i = 0; i < num_funcs; i++) {
+									function_items.push_back(items.size());
+									opt_io.TraceFunction(i);
+									HandleFunctionBody();
+									if(extract_metadata) {
+										body_items[i] = { function_items.back(), items.size() };
+									}
+								}
 							}
+							function_items.push_back(items.size());
 							break;
 						}
 						case wasm::BinaryConsts::Section::Data: {
+							data_section          = items.size() - 1;
 							uint32_t num_segments = HandleNum();
 							for(uint32_t i = 0; i < num_segments; i++) {
 								uint8_t flags = HandleFlags(2);
 
+								size_t offset_item = items.size();
 								if(flags == 0) {
 									HandleInstructions();
 								}
 
 								size_t slice_size = HandleSize();
 								HandleSlice(slice_size);
+
+								// Active segments at a single constant offset
+								if(flags == 0 && IsI32Const(offset_item)
+									&& IsInstruction(offset_item + 2, wasm::BinaryConsts::End)) {
+									active_segments.push_back(
+										{ GetI32(offset_item), items.size() - 1 });
+								} else if(flags != 1) {
+									all_segments_constant = false;
+								}
 							}
 							break;
 						}
@@ -1789,6 +3172,15 @@ namespace Mni {
 						}
 						}
 					}
+
+					opt_io.EndTrace();
+					if(mode == READ_OPTIMIZED && opt_io.UsesColumns()) {
+						opt_io.EndColumns();
+					}
+
+					if(extract_metadata) {
+						FillMetadata();
+					}
 				} else {
 					if(mode == WRITE_NORMAL) {
 						// Append magic and version, required in the webassembly
@@ -1799,146 +3191,158 @@ namespace Mni {
 
 					if(mode == WRITE_OPTIMIZED) {
 						// Write some header information
-						// Starting with huffman trees (if they exist)
-						opt_io.WriteUNum(io.huffman.INSTRUCTION_rep, 1);
-						if(opt_io.huffman.INSTRUCTION_rep) {
-							opt_io.WriteHuffmanHeader(opt_io.huffman.INSTRUCTION_rep_map);
+						// Starting with the metadata block, so it can be read on its own
+						opt_io.WriteMetadata();
+						opt_io.WriteDictionaryVersion();
+						// Then whether the stream is split into columns and whether final
+						// ends are left out
+						opt_io.WriteUNum(opt_io.UsesColumns(), 1);
+						opt_io.WriteUNum(opt_io.IsStructured(), 1);
+						// Then huffman trees (if they pay for themselves)
+						opt_io.WriteHuffmanHeaders();
+						opt_io.WriteFunctionIndex();
+						if(opt_io.UsesColumns()) {
+							opt_io.WriteColumnHeader();
+							opt_io.StartColumns();
 						}
 					}
 
-					for(size_t i = 0; i < items.size(); i++) {
-						switch(items[i]->type) {
-						case NUM:
-							HandleNum();
-							break;
-						case SIZE:
-							HandleSize();
-							break;
-						case SECTION:
-							HandleSection();
-							break;
-						case STRING:
-							HandleString();
-							break;
-						case TYPE:
-							HandleType();
-							break;
-						case INDEXED_TYPE:
-							HandleIndexedType();
-							break;
-						case LIMIT:
-							HandleLimits();
-							break;
-						case MEMORY_OP:
-							HandleMemoryOp();
-							break;
-						case INSTRUCTION:
-							HandleInstruction();
-							break;
-						case INSTRUCTION32:
-							HandleInstruction32();
-							break;
-						case ATTRIBUTE:
-							HandleAttribute();
-							break;
-						case BREAK:
-							HandleBreak();
-							break;
-						case FUNCTION:
-						case TABLE:
-						case LOCAL:
-						case GLOBAL:
-						case MEMORY:
-						case TAG:
-						case STRUCT:
-							HandleIndex(items[i]->type);
-							break;
-						case I32:
-							HandleI32();
-							break;
-						case I64:
-							HandleI64();
-							break;
-						case I128:
-							HandleV128();
-							break;
-						case F32:
-							HandleF32();
-							break;
-						case F64:
-							HandleF64();
-							break;
-						case ATOMIC_ORDER:
-							HandleAtomicOrder();
-							break;
-						case SEGMENT:
-							HandleSegment();
-							break;
-						case MEMORY_IDX:
-							HandleMemory();
-							break;
-						case LANE:
-							HandleLane();
-							break;
-						case EXTERNAL:
-							HandleExternal();
-							break;
-						case FLAGS:
-							HandleFlags(0);
-							break;
-						case DATA:
-							HandleSlice(0);
-							break;
+					// Bit position of every function body followed by the end of the last
+					std::vector<uint64_t> function_bits;
+					size_t next_function = 0;
+					auto RecordFunctionBits = [&]() {
+						while(next_function < function_items.size()
+							  && function_items[next_function] == item_idx) {
+							function_bits.push_back(opt_io.GetCurrentBit());
+							next_function++;
 						}
+					};
 
-						item_idx++;
+					std::vector<WasmEncoded> encoded;
+					if(mode == WRITE_OPTIMIZED && parallel) {
+						encoded = EncodeParallelFunctionBodies();
+					}
+
+					size_t next_body = 0;
+					size_t next_start = 0;
+					for(item_idx = 0; item_idx < items.size(); item_idx++) {
+						RecordFunctionBits();
+						// The last entry of function_items is the end of the code section
+						if(next_start + 1 < function_items.size()
+							&& function_items[next_start] == item_idx) {
+							StartBody(item_idx);
+							opt_io.TraceFunction(next_start);
+							next_start++;
+						}
+						if(next_body < encoded.size() && item_idx == function_items[next_body]) {
+							// Skip the items of the body, continuing after it
+							HandleEncoded(encoded[next_body]);
+							item_idx = function_items[++next_body] - 1;
+							continue;
+						}
+						HandleItem(items[item_idx]);
 					}
+					RecordFunctionBits();
 
 					if(mode == WRITE_OPTIMIZED) {
-						// Prepend size so end can be determined later during
-						// reading
-						opt_io.PrependSize();
+						opt_io.EndTrace();
+						if(opt_io.UsesColumns()) {
+							opt_io.EndColumns();
+						}
+						if(opt_io.HasFunctionIndex()) {
+							opt_io.InsertFunctionIndex(function_bits);
+						}
+
+						// Prepend the header so the end can be determined and the
+						// stream checked before reading
+						opt_io.PrependHeader();
 					}
 				}
 			};
 
-			mode = in;
-			HandleReadOrWrite();
-			if(out != NONE) {
-				mode = out;
+			if(in != NONE) {
+				mode = in;
 				HandleReadOrWrite();
 			}
-
-			for(auto item : items) {
-				// Deallocate webassembly items
-				delete item;
+			// Nothing is written from a damaged stream
+			if(out != NONE && !opt_io.Failed()) {
+				mode = out;
+				HandleReadOrWrite();
 			}
 		}
 
-		uint64_t NormalToOptimized(
-			std::vector<uint8_t>& wasm_bytes, uint64_t current_bit, std::vector<uint8_t>& bytes) {
+		uint64_t NormalToOptimized(std::vector<uint8_t>& wasm_bytes, uint64_t current_bit,
+			std::vector<uint8_t>& bytes, OptimizedOptions options) {
 			constexpr bool generate_huffman_trees = true;
 
 			// Construct neccesary huffman trees
 			Huffman huffman;
 			if(generate_huffman_trees) {
-				huffman.INSTRUCTION_construct = true;
+				huffman.SetConstruct(true);
 			}
 
+			// Parse once, every following pass only writes these items
+			ParsedWasm parsed;
 			IO io(wasm_bytes, huffman);
 			OptimizedIO opt_io(bytes, current_bit, huffman);
-			ConvertWasm(READ_NORMAL, NONE, io, opt_io);
+			opt_io.SetColumns(options.columns);
+			// Bodies are not contiguous when split into columns
+			opt_io.SetFunctionIndex(options.function_index && !options.columns);
+			opt_io.SetMetadata(options.metadata);
+			opt_io.SetDictionary(DICTIONARY_VERSION);
+			bool parallel
+				= options.parallel && !options.columns && !options.trace && !options.reparse;
+			ConvertWasm(READ_NORMAL, NONE, io, opt_io, SCOPE_MODULE, parallel, &parsed);
+
+			auto WriteOptimized = [&](OptimizedIO& out_io, bool parallel_write) {
+				if(options.reparse) {
+					io.Reset();
+					ConvertWasm(READ_NORMAL, WRITE_OPTIMIZED, io, out_io);
+				} else {
+					ConvertWasm(
+						NONE, WRITE_OPTIMIZED, io, out_io, SCOPE_MODULE, parallel_write, &parsed);
+				}
+			};
+
+			// Final ends are only left out when the decoder can find them from the body sizes
+			opt_io.SetStructured(BodySizesMatch(parsed));
+			if(!opt_io.IsStructured()) {
+				for(size_t i = 0; i + 1 < parsed.function_items.size(); i++) {
+					huffman.Count<INSTRUCTION>(wasm::BinaryConsts::End);
+				}
+			}
 
 			if(generate_huffman_trees) {
-				huffman.INSTRUCTION_generate_rep();
+				opt_io.ChooseBlockTable();
+				opt_io.GenerateHuffmanReps();
 			}
 
 			// Generate optimized with huffman trees
 			if(generate_huffman_trees) {
-				huffman.INSTRUCTION_construct = false;
+				huffman.SetConstruct(false);
+			}
+
+			if(options.columns) {
+				// Measure the LEBs every column writes to choose its width, which can
+				// change which huffman tables pay for themselves
+				std::vector<uint8_t> measure_bytes;
+				OptimizedIO measure_io(measure_bytes, 0, huffman);
+				measure_io.SetColumns(true);
+				measure_io.SetStructured(opt_io.IsStructured());
+				measure_io.SetDictionary(DICTIONARY_VERSION);
+				WriteOptimized(measure_io, false);
+				opt_io.SetColumnLEBMultiples(measure_io.ChooseColumnLEBMultiples());
+
+				if(generate_huffman_trees) {
+					opt_io.GenerateHuffmanReps();
+				}
+			}
+
+			if(options.trace) {
+				options.trace->clear();
+				opt_io.SetTrace(options.trace);
 			}
-			io.Reset();
-			ConvertWasm(READ_NORMAL, WRITE_OPTIMIZED, io, opt_io);
+			WriteOptimized(opt_io, parallel);
 			return opt_io.GetCurrentBit();
 		}
 
@@ -1947,8 +3351,285 @@ namespace Mni {
 			Huffman huffman;
 			IO io(wasm_bytes, huffman);
 			OptimizedIO opt_io(bytes, current_bit, huffman);
+			opt_io.SetReadLimits(bytes.size() * 8);
 			ConvertWasm(READ_OPTIMIZED, WRITE_NORMAL, io, opt_io);
+			if(opt_io.Failed()) {
+				wasm_bytes.clear();
+				return 0;
+			}
 			return opt_io.GetCurrentBit();
 		}
+
+		uint64_t OptimizedToNormal(std::vector<uint8_t>& wasm_bytes, uint64_t current_bit,
+			std::vector<uint8_t>& bytes, std::vector<ActiveSegment>& segments) {
+			Huffman huffman;
+			IO io(wasm_bytes, huffman);
+			OptimizedIO opt_io(bytes, current_bit, huffman);
+			opt_io.SetReadLimits(bytes.size() * 8);
+			ParsedWasm parsed;
+			ConvertWasm(READ_OPTIMIZED, NONE, io, opt_io, SCOPE_MODULE, false, &parsed);
+			segments.clear();
+			if(opt_io.Failed()) {
+				wasm_bytes.clear();
+				return 0;
+			}
+
+			// A start function runs before anything could be copied, so it has to see the data
+			// Segments are copied in through the memory export, so it has to be unambiguous
+			if(!parsed.has_start && parsed.exports_memory && !parsed.exports_other_memory
+				&& parsed.all_segments_constant && parsed.data_section != SIZE_MAX) {
+				auto section = (WasmSection*)parsed.items[parsed.data_section];
+				for(auto& [offset, data_item] : parsed.active_segments) {
+					auto data = (WasmData*)parsed.items[data_item];
+					auto size = (WasmSize*)parsed.items[data_item - 1];
+					// The segment stays, only its bytes are left out
+					section->size -= ULEBBytes(size->size) - ULEBBytes(0) + size->size;
+					size->size = 0;
+					if(data->storage.empty()) {
+						data->storage.assign(data->data.begin(), data->data.end());
+					}
+					segments.push_back({ (uint32_t)offset, std::move(data->storage) });
+					data->data = {};
+				}
+			}
+
+			ConvertWasm(NONE, WRITE_NORMAL, io, opt_io, SCOPE_MODULE, false, &parsed);
+			return opt_io.GetCurrentBit();
+		}
+
+		bool CheckPayload(std::vector<uint8_t>& bytes, uint64_t current_bit) {
+			Huffman huffman;
+			OptimizedIO opt_io(bytes, current_bit, huffman);
+			opt_io.SetReadLimits(bytes.size() * 8);
+			return opt_io.ReadHeader();
+		}
+
+		bool SealPayload(std::vector<uint8_t>& bytes, uint64_t current_bit) {
+			Huffman huffman;
+			OptimizedIO opt_io(bytes, current_bit, huffman);
+			opt_io.SetReadLimits(bytes.size() * 8);
+			return opt_io.SealHeader();
+		}
+
+		bool ReadMetadata(std::vector<uint8_t>& bytes, uint64_t current_bit, Metadata& metadata) {
+			Huffman huffman;
+			OptimizedIO opt_io(bytes, current_bit, huffman);
+			opt_io.SetReadLimits(bytes.size() * 8);
+			if(!opt_io.ReadHeader()) {
+				return false;
+			}
+			opt_io.ReadMetadata();
+			if(!opt_io.HasMetadata() || opt_io.Failed()) {
+				return false;
+			}
+
+			metadata = opt_io.GetMetadata();
+			return true;
+		}
+
+		bool ScanExports(std::vector<uint8_t>& wasm_bytes, std::vector<std::string>& exports,
+			std::vector<std::string>* imports) {
+			exports.clear();
+			if(imports) {
+				imports->clear();
+			}
+			if(wasm_bytes.size() < 8 || std::memcmp(wasm_bytes.data(), "\0asm", 4) != 0) {
+				return false;
+			}
+
+			Huffman huffman;
+			IO io(wasm_bytes, huffman);
+			io.Skip(8);
+
+			size_t end = wasm_bytes.size();
+			// Reads are checked against the end of the current section
+			auto Fits = [&](uint64_t len) {
+				return io.GetPos() <= end && len <= end - io.GetPos();
+			};
+			auto ReadName = [&](std::string_view& name) {
+				uint64_t len = io.ReadULEB();
+				if(!Fits(len)) {
+					return false;
+				}
+				name = std::string_view((const char*)wasm_bytes.data() + io.GetPos(), len);
+				io.Skip(len);
+				return true;
+			};
+			auto SkipLimits = [&]() {
+				if(!Fits(1)) {
+					return false;
+				}
+				uint8_t flags = io.ReadU8();
+				io.ReadULEB();
+				if(flags & 1) {
+					io.ReadULEB();
+				}
+				return Fits(0);
+			};
+
+			while(!io.Done()) {
+				uint8_t id    = io.ReadU8();
+				end           = wasm_bytes.size();
+				uint64_t size = io.ReadULEB();
+				if(!Fits(size)) {
+					return false;
+				}
+				end = io.GetPos() + size;
+
+				switch(id) {
+				case wasm::BinaryConsts::Section::Import: {
+					uint64_t num_imports = io.ReadULEB();
+					for(uint64_t i = 0; i < num_imports; i++) {
+						std::string_view module, name;
+						if(!ReadName(module) || !ReadName(name) || !Fits(1)) {
+							return false;
+						}
+						uint8_t kind = io.ReadU8();
+						switch((wasm::ExternalKind)kind) {
+						case wasm::ExternalKind::Function: {
+							io.ReadULEB();
+							if(imports) {
+								imports->push_back(std::string(name));
+							}
+						} break;
+						case wasm::ExternalKind::Table: {
+							if(!Fits(1)) {
+								return false;
+							}
+							io.ReadU8();
+							if(!SkipLimits()) {
+								return false;
+							}
+						} break;
+						case wasm::ExternalKind::Memory: {
+							if(!SkipLimits()) {
+								return false;
+							}
+						} break;
+						case wasm::ExternalKind::Global: {
+							if(!Fits(2)) {
+								return false;
+							}
+							io.Skip(2);
+						} break;
+						case wasm::ExternalKind::Tag: {
+							if(!Fits(1)) {
+								return false;
+							}
+							io.ReadU8();
+							io.ReadULEB();
+						} break;
+						default:
+							return false;
+						}
+					}
+				} break;
+				case wasm::BinaryConsts::Section::Export: {
+					uint64_t num_exports = io.ReadULEB();
+					for(uint64_t i = 0; i < num_exports; i++) {
+						std::string_view name;
+						if(!ReadName(name) || !Fits(1)) {
+							return false;
+						}
+						uint8_t kind = io.ReadU8();
+						io.ReadULEB();
+						if((wasm::ExternalKind)kind == wasm::ExternalKind::Function) {
+							exports.push_back(std::string(name));
+						}
+					}
+					// Nothing after the export section is needed
+					return Fits(0);
+				}
+				}
+
+				if(!Fits(0)) {
+					return false;
+				}
+				io.Skip(end - io.GetPos());
+			}
+			return true;
+		}
+
+		bool DecodeFunction(std::vector<uint8_t>& bytes, uint64_t current_bit, uint32_t function,
+			std::vector<uint8_t>& body) {
+			Huffman huffman;
+			OptimizedIO opt_io(bytes, current_bit, huffman);
+			opt_io.SetReadLimits(bytes.size() * 8);
+			if(ReadOptimizedHeader(opt_io) || !opt_io.HasFunctionIndex() || opt_io.Failed()) {
+				return false;
+			}
+
+			auto& starts = opt_io.GetFunctionStarts();
+			if(function + 1 >= starts.size()) {
+				return false;
+			}
+
+			body.clear();
+			return DecodeFunctionBody(opt_io, starts[function], starts[function + 1], body)
+				   == starts[function + 1];
+		}
+
+		std::string_view ItemName(const TracedItem& item) {
+			if(item.type == INSTRUCTION && item.value < INSTRUCTION_NAMES.size()
+				&& !INSTRUCTION_NAMES[item.value].empty()) {
+				return INSTRUCTION_NAMES[item.value];
+			}
+			return ITEM_TYPE_NAMES[item.type];
+		}
+
+		std::string_view ItemTypeName(WasmItemType type) {
+			return ITEM_TYPE_NAMES[type];
+		}
+
+		std::string_view SectionName(uint8_t id) {
+			static constexpr std::string_view names[NUM_SECTIONS] = { "custom", "type", "import",
+				"function", "table", "memory", "global", "export", "start", "element", "code",
+				"data", "datacount", "tag" };
+			return id < NUM_SECTIONS ? names[id] : "unknown";
+		}
+
+		BitStats CountBits(const std::vector<TracedItem>& trace, uint64_t total_bits) {
+			BitStats stats;
+			stats.total_bits   = total_bits;
+			uint64_t item_bits = 0;
+			for(auto& item : trace) {
+				item_bits += item.bits;
+				stats.type_bits[item.type] += item.bits;
+				stats.type_items[item.type]++;
+				if(item.section < NUM_SECTIONS) {
+					stats.section_bits[item.section] += item.bits;
+				}
+				if(item.function != NO_FUNCTION) {
+					if(item.function >= stats.function_bits.size()) {
+						stats.function_bits.resize(item.function + 1);
+					}
+					stats.function_bits[item.function] += item.bits;
+				}
+			}
+			stats.header_bits = total_bits > item_bits ? total_bits - item_bits : 0;
+			return stats;
+		}
+
+		bool TraceItems(
+			std::vector<uint8_t>& bytes, bool optimized, std::vector<TracedItem>& trace) {
+			Huffman huffman;
+			// Nothing is written to the other stream
+			std::vector<uint8_t> unused_bytes;
+			trace.clear();
+			if(optimized) {
+				IO io(unused_bytes, huffman);
+				OptimizedIO opt_io(bytes, 0, huffman);
+				opt_io.SetReadLimits(bytes.size() * 8);
+				opt_io.SetTrace(&trace);
+				ConvertWasm(READ_OPTIMIZED, NONE, io, opt_io);
+				return !opt_io.Failed();
+			}
+
+			IO io(bytes, huffman);
+			OptimizedIO opt_io(unused_bytes, 0, huffman);
+			opt_io.SetTrace(&trace, &io);
+			ConvertWasm(READ_NORMAL, NONE, io, opt_io);
+			return true;
+		}
 	}
 }
\ No newline at end of file
@@ -177,20 +177,38 @@ namespace Mni {
 			error = wasmtime_linker_instantiate(linker, context, module, &instance, &trap);
 			HandleErrors();
 
-			// Find memory base
+			// Find memory base, the first memory export like the decoder expects
 			char* item_name;
 			size_t item_name_size;
 			wasmtime_extern_t item;
 			size_t export_index = 0;
-			while(wasmtime_instance_export_nth(
-				context, &instance, export_index, &item_name, &item_name_size, &item)) {
+			size_t memory_size  = 0;
+			bool found_memory   = false;
+			memory_base         = nullptr;
+			while(!found_memory
+				&& wasmtime_instance_export_nth(
+					context, &instance, export_index, &item_name, &item_name_size, &item)) {
 				if(item.kind == WASMTIME_EXTERN_MEMORY) {
 					wasmtime_memory_t memory = item.of.memory;
 					memory_base              = wasmtime_memory_data(context, &memory);
+					memory_size              = wasmtime_memory_data_size(context, &memory);
+					found_memory             = true;
 				}
 				export_index++;
 			}
 
+			// Data the decoder left out, which is either none or every active segment, in segment
+			// order like instantiation would copy it
+			for(auto& segment : segments) {
+				if(memory_base == nullptr
+					|| (uint64_t)segment.offset + segment.bytes.size() > memory_size) {
+					std::cerr << "Data segment out of bounds" << std::endl;
+					return false;
+				}
+				std::copy(segment.bytes.begin(), segment.bytes.end(), memory_base + segment.offset);
+			}
+			segments = {};
+
 			GET_EXPORT(prepare)
 			GET_EXPORT(name)
 			GET_EXPORT(render)
@@ -214,6 +232,10 @@ namespace Mni {
 				meta.name           = std::string((char*)(memory_base + name_addr_value));
 			}
 
+			// Bounds after mni_prepare has run
+			meta.width  = width;
+			meta.height = height;
+
 			return true;
 		}
 
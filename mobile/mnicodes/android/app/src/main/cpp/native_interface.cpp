@@ -8,11 +8,16 @@ bool NativeInterface::LoadFromBuffer(uint8_t* buffer, size_t size) {
 		|| (optimized_wasm_bytes.size() != size
 			&& std::memcmp(optimized_wasm_bytes.data(), buffer, size) != 0)) {
 		optimized_wasm_bytes.assign(buffer, buffer + size);
-		Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, optimized_wasm_bytes);
+		// Corrupt frames are rejected so the next one can be tried
+		std::vector<Mni::Wasm::ActiveSegment> segments;
+		if(!Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, optimized_wasm_bytes, segments)) {
+			optimized_wasm_bytes.clear();
+			return false;
+		}
 
 		if(runtime)
 			runtime->Close();
-		runtime = std::make_shared<Mni::Wasm::Runtime>(wasm_bytes);
+		runtime = std::make_shared<Mni::Wasm::Runtime>(wasm_bytes, std::move(segments));
 
 		if(!runtime->PrepareWasm()) {
 			return false;
@@ -0,0 +1,28 @@
+#include <mni/wasm/parser.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// libFuzzer entry point, every decoder has to return on any input
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	std::vector<uint8_t> bytes(data, data + size);
+	// Mutations would mostly stop at the checksum
+	Mni::Wasm::SealPayload(bytes, 0);
+
+	std::vector<uint8_t> wasm_bytes;
+	Mni::Wasm::OptimizedToNormal(wasm_bytes, 0, bytes);
+
+	Mni::Wasm::Metadata metadata;
+	Mni::Wasm::ReadMetadata(bytes, 0, metadata);
+
+	std::vector<std::string> exports, imports;
+	Mni::Wasm::ScanExports(bytes, exports, &imports);
+
+	std::vector<uint8_t> body;
+	for(uint32_t function = 0; function < 4; function++) {
+		Mni::Wasm::DecodeFunction(bytes, 0, function, body);
+	}
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include <mni.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// Test storing, finding and evicting compile results
+TEST(Cache, StoreAndLoad) {
+	auto dir = std::filesystem::temp_directory_path() / "mni_test_cache";
+	std::filesystem::remove_all(dir);
+
+	std::vector<uint8_t> wasm_bytes = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+	std::string key                 = Mni::Cache::Key(wasm_bytes, "columns=0");
+	EXPECT_EQ(key, Mni::Cache::Key(wasm_bytes, "columns=0"));
+	EXPECT_NE(key, Mni::Cache::Key(wasm_bytes, "columns=1"));
+
+	Mni::Cache::Entry entry;
+	EXPECT_FALSE(Mni::Cache::Load(dir, key, entry));
+
+	Mni::Cache::Entry stored { .wasm = wasm_bytes,
+		.exports   = { "mni_prepare", "mni_render" },
+		.optimized = { 0x12, 0x34, 0x50 },
+		.size      = 20 };
+	EXPECT_TRUE(Mni::Cache::Store(dir, key, stored, 1 << 20));
+	EXPECT_TRUE(Mni::Cache::Load(dir, key, entry));
+	EXPECT_EQ(entry.wasm, stored.wasm);
+	EXPECT_EQ(entry.exports, stored.exports);
+	EXPECT_EQ(entry.optimized, stored.optimized);
+	EXPECT_EQ(entry.size, stored.size);
+	EXPECT_TRUE(entry.qr_png.empty());
+
+	// Storing again replaces the entry, here adding its QR code
+	stored.qr_png = { 0x89, 0x50, 0x4e, 0x47 };
+	EXPECT_TRUE(Mni::Cache::Store(dir, key, stored, 1 << 20));
+	EXPECT_TRUE(Mni::Cache::Load(dir, key, entry));
+	EXPECT_EQ(entry.qr_png, stored.qr_png);
+
+	// Only the most recent entry fits
+	std::vector<uint8_t> other_bytes = wasm_bytes;
+	other_bytes.push_back(0);
+	std::string other_key = Mni::Cache::Key(other_bytes, "columns=0");
+	EXPECT_TRUE(Mni::Cache::Store(dir, other_key, stored, 64));
+	EXPECT_FALSE(Mni::Cache::Load(dir, key, entry));
+	EXPECT_TRUE(Mni::Cache::Load(dir, other_key, entry));
+
+	// Entries still being written by another process are never evicted
+	auto writing = dir / ".writing";
+	std::filesystem::create_directory(writing);
+	std::ofstream(writing / "wasm") << std::string(1024, 'x');
+	EXPECT_TRUE(Mni::Cache::Store(dir, key, stored, 64));
+	EXPECT_TRUE(std::filesystem::exists(writing / "wasm"));
+
+	std::filesystem::remove_all(dir);
+}
@@ -64,3 +64,141 @@ TEST(Encoding, MoveBits) {
 		EXPECT_STREQ(pre_unmoved_left.c_str(), post_unmoved_left.c_str());
 	}
 }
+
+// Test bit copies between buffers at every alignment
+TEST(Encoding, CopyBits) {
+	std::mt19937 rng(1);
+	auto byte_dist   = std::uniform_int_distribution { 0, 255 };
+	auto offset_dist = std::uniform_int_distribution { 0, 64 };
+	auto size_dist   = std::uniform_int_distribution { 0, 200 };
+
+	for(int i = 0; i < 10000; i++) {
+		std::vector<uint8_t> src(40);
+		std::vector<uint8_t> dest(40);
+		for(auto& b : src) {
+			b = byte_dist(rng);
+		}
+		for(auto& b : dest) {
+			b = byte_dist(rng);
+		}
+		std::vector<uint8_t> original_dest = dest;
+
+		uint64_t start     = offset_dist(rng);
+		uint64_t size      = size_dist(rng);
+		uint64_t new_start = offset_dist(rng);
+		EXPECT_EQ(Mni::Encoding::CopyBits(start, start + size, new_start, src, dest),
+			new_start + size);
+
+		for(uint64_t bit = 0; bit < original_dest.size() * 8; bit++) {
+			bool expected;
+			bool actual;
+			if(bit >= new_start && bit < new_start + size) {
+				Mni::Decoding::Read1Bit(&expected, start + bit - new_start, src);
+			} else {
+				Mni::Decoding::Read1Bit(&expected, bit, original_dest);
+			}
+			Mni::Decoding::Read1Bit(&actual, bit, dest);
+			EXPECT_EQ(expected, actual);
+		}
+	}
+}
+
+// Test huffman tables round trip through flat decode tables, including 0 and single symbols
+TEST(Encoding, HuffmanFlatTable) {
+	std::mt19937 rng(1);
+	auto value_dist = std::uniform_int_distribution { 0, 20 };
+	auto size_dist  = std::uniform_int_distribution { 1, 200 };
+
+	for(int i = 0; i < 1000; i++) {
+		std::vector<uint32_t> data;
+		int size = size_dist(rng);
+		for(int j = 0; j < size; j++) {
+			// Every 10th list only has a single element, producing a 0 bit representation
+			data.push_back(i % 10 == 0 ? 0 : value_dist(rng));
+		}
+
+		std::vector<uint8_t> bytes;
+		std::unordered_map<uint32_t, Mni::Tree::NodeRepresentation> rep_map;
+		uint64_t current_bit = Mni::Encoding::WriteHuffmanHeader(data, rep_map, 0, bytes);
+		uint64_t header_bit  = current_bit;
+		for(auto num : data) {
+			auto& rep   = rep_map.at(num);
+			current_bit = Mni::Encoding::WriteNumUnsigned(
+				rep.representation, rep.bit_size, current_bit, bytes);
+		}
+		if(i % 10 == 0) {
+			EXPECT_EQ(rep_map.at(0).bit_size, 0);
+			EXPECT_EQ(current_bit, header_bit);
+		}
+		// Padding so reads of 0 bit representations stay in bounds
+		bytes.push_back(0);
+
+		std::vector<Mni::Tree::FlatNode<uint32_t>> nodes;
+		uint64_t read_bit = Mni::Decoding::ReadHuffmanHeader(nodes, 0, bytes);
+		for(auto num : data) {
+			uint32_t out;
+			read_bit = Mni::Decoding::ReadHuffmanValue(nodes, &out, read_bit, bytes);
+			EXPECT_EQ(num, out);
+		}
+		EXPECT_EQ(current_bit, read_bit);
+	}
+}
+
+// Test LZ parse and match expansion, with and without a preset dictionary
+TEST(Encoding, LzRoundtrip) {
+	std::mt19937 rng(3);
+	std::vector<uint8_t> preset;
+	for(int i = 0; i < 500; i++) {
+		preset.push_back(rng() % 8);
+	}
+	Mni::Lz::Dictionary dictionary(preset);
+
+	auto byte_dist   = std::uniform_int_distribution { 0, 3 };
+	auto length_dist = std::uniform_int_distribution { 1, 40 };
+
+	for(int i = 0; i < 200; i++) {
+		// Mix of zero padding, repeats and noise similar to data segments
+		std::vector<uint8_t> data;
+		while(data.size() < 2000) {
+			int length = length_dist(rng);
+			switch(byte_dist(rng)) {
+			case 0:
+				data.insert(data.end(), length, 0);
+				break;
+			case 1:
+				if(i % 2 == 1) {
+					size_t start = rng() % (preset.size() - length);
+					data.insert(data.end(), preset.begin() + start, preset.begin() + start + length);
+				} else if(!data.empty()) {
+					size_t start = rng() % data.size();
+					for(int j = 0; j < length; j++) {
+						data.push_back(data[start + j]);
+					}
+				}
+				break;
+			default:
+				for(int j = 0; j < length; j++) {
+					data.push_back(rng());
+				}
+			}
+		}
+
+		auto* used = i % 2 == 1 ? &dictionary : nullptr;
+		std::vector<uint8_t> out;
+		for(auto& token : Mni::Lz::Parse(data, used)) {
+			switch(token.type) {
+			case Mni::Lz::LITERAL:
+				out.push_back(token.literal);
+				break;
+			case Mni::Lz::ZERO_RUN:
+				out.insert(out.end(), token.length, 0);
+				break;
+			case Mni::Lz::MATCH:
+				EXPECT_TRUE(Mni::Lz::AppendMatch(out, token.distance, token.length,
+					used ? used->bytes : std::span<const uint8_t>()));
+				break;
+			}
+		}
+		EXPECT_EQ(data, out);
+	}
+}
@@ -1,42 +1,622 @@
 #include <gtest/gtest.h>
 #include <mni.hpp>
 #include <mni/wasm/parser.hpp>
+#include <mni/wasm/signatures.hpp>
 #include <wasm-tools.h>
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
 #include <random>
 #include <vector>
 
-// Test optimizing to bitcode (mni.codes)
-TEST(Wasm, OptimizeTiny) {
+// Run test on valid modules generated by wasm-smith from a seeded random stream
+static void ForEachModule(
+	uint32_t seed, int num_modules, const std::function<void(std::vector<uint8_t>&, int)>& test) {
 	wasm_tools_byte_vec_t module;
-	std::mt19937 rng(1);
+	std::mt19937 rng(seed);
 	std::uniform_int_distribution<int> dist(1, 255);
 
-	constexpr int NUM_MODULES  = 2000;
 	constexpr int SIZE_MODULES = 10000;
 
-	for(int i = 0; i < NUM_MODULES; i++) {
-		char seed[SIZE_MODULES];
+	for(int i = 0; i < num_modules; i++) {
+		char seed_bytes[SIZE_MODULES];
 		for(int j = 0; j < SIZE_MODULES; j++) {
-			seed[j] = dist(rng) & 0xFF;
+			seed_bytes[j] = dist(rng) & 0xFF;
 		}
 
-		// Generate module with default config
-		if(!wasm_smith_create(seed, SIZE_MODULES, &module)) {
+		if(!wasm_smith_create(seed_bytes, SIZE_MODULES, &module)) {
 			std::vector<uint8_t> data(module.data, module.data + module.size);
+			test(data, i);
+			wasm_tools_byte_vec_delete(&module);
+		}
+	}
+}
+
+// Function bodies of the code section, each with its size
+static std::vector<std::vector<uint8_t>> CodeBodies(const std::vector<uint8_t>& data) {
+	size_t offset = 8;
+	auto ReadULEB = [&]() {
+		uint64_t num = 0;
+		for(int shift = 0; offset < data.size(); shift += 7) {
+			uint8_t byte = data[offset++];
+			num |= (uint64_t)(byte & 0x7F) << shift;
+			if(!(byte & 0x80)) {
+				break;
+			}
+		}
+		return num;
+	};
 
-			std::vector<uint8_t> optimized_bytes;
-			Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
-			std::vector<uint8_t> new_data(module.size);
-			Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes);
+	std::vector<std::vector<uint8_t>> bodies;
+	while(offset < data.size()) {
+		uint8_t id   = data[offset++];
+		uint64_t end = ReadULEB();
+		end += offset;
+		if(id == 10) {
+			uint64_t count = ReadULEB();
+			for(uint64_t i = 0; i < count; i++) {
+				size_t start = offset;
+				offset += ReadULEB();
+				bodies.emplace_back(data.begin() + start, data.begin() + offset);
+			}
+		}
+		offset = end;
+	}
+	return bodies;
+}
 
-			EXPECT_EQ(data.size(), new_data.size());
-			EXPECT_EQ(data, new_data);
+// Test optimizing to bitcode (mni.codes)
+TEST(Wasm, OptimizeTiny) {
+	ForEachModule(1, 2000, [](std::vector<uint8_t>& data, int) {
+		std::vector<uint8_t> optimized_bytes;
+		Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+		std::vector<uint8_t> new_data(data.size());
+		Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes);
 
-			wasm_tools_byte_vec_delete(&module);
+		EXPECT_EQ(data.size(), new_data.size());
+		EXPECT_EQ(data, new_data);
+	});
+}
+
+// Test optimizing to bitcode split into columns
+TEST(Wasm, OptimizeColumns) {
+	ForEachModule(2, 500, [](std::vector<uint8_t>& data, int) {
+		std::vector<uint8_t> optimized_bytes;
+		Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes, { .columns = true });
+		std::vector<uint8_t> new_data(data.size());
+		Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes);
+
+		EXPECT_EQ(data, new_data);
+	});
+}
+
+// Test decoding function bodies through the function index
+TEST(Wasm, FunctionIndex) {
+	ForEachModule(3, 500, [](std::vector<uint8_t>& data, int) {
+		std::vector<uint8_t> optimized_bytes;
+		Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes, { .function_index = true });
+		std::vector<uint8_t> new_data(data.size());
+		Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes);
+
+		EXPECT_EQ(data, new_data);
+
+		// Every decoded body is the original body at the same index
+		auto bodies = CodeBodies(data);
+		std::vector<uint8_t> body;
+		uint32_t function = 0;
+		for(; Mni::Wasm::DecodeFunction(optimized_bytes, 0, function, body); function++) {
+			ASSERT_LT(function, bodies.size());
+			EXPECT_EQ(body, bodies[function]);
+		}
+		EXPECT_EQ(function, bodies.size());
+	});
+}
+
+// Test encoding function bodies in parallel matches the sequential encoder
+TEST(Wasm, OptimizeParallel) {
+	ForEachModule(4, 200, [](std::vector<uint8_t>& data, int) {
+		std::vector<uint8_t> sequential_bytes;
+		uint64_t sequential_size = Mni::Wasm::NormalToOptimized(data, 0, sequential_bytes);
+		std::vector<uint8_t> parallel_bytes;
+		uint64_t parallel_size
+			= Mni::Wasm::NormalToOptimized(data, 0, parallel_bytes, { .parallel = true });
+
+		EXPECT_EQ(sequential_size, parallel_size);
+		EXPECT_EQ(sequential_bytes, parallel_bytes);
+	});
+}
+
+// Test encoding the kept items matches parsing the module again in every pass
+TEST(Wasm, OptimizeReparse) {
+	ForEachModule(9, 200, [](std::vector<uint8_t>& data, int i) {
+		Mni::Wasm::OptimizedOptions options {
+			.columns = i % 3 == 1, .function_index = i % 3 == 2, .metadata = i % 2 == 1
+		};
+		std::vector<uint8_t> kept_bytes;
+		uint64_t kept_size = Mni::Wasm::NormalToOptimized(data, 0, kept_bytes, options);
+		options.reparse = true;
+		std::vector<uint8_t> reparsed_bytes;
+		uint64_t reparsed_size = Mni::Wasm::NormalToOptimized(data, 0, reparsed_bytes, options);
+
+		EXPECT_EQ(kept_size, reparsed_size);
+		EXPECT_EQ(kept_bytes, reparsed_bytes);
+	});
+}
+
+// (import "env" "mni_set_bounds" (func (param i32 i32)))
+// mni_name returns 16, mni_prepare calls mni_set_bounds(300, 200), memory is exported
+// (data (i32.const 0) "abcd") (data (i32.const 16) "Hello Codes\00")
+static const std::vector<uint8_t> METADATA_MODULE = {
+	// clang-format off
+	0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0d, 0x03, 0x60,
+	0x02, 0x7f, 0x7f, 0x00, 0x60, 0x00, 0x01, 0x7f, 0x60, 0x00, 0x00, 0x02,
+	0x16, 0x01, 0x03, 0x65, 0x6e, 0x76, 0x0e, 0x6d, 0x6e, 0x69, 0x5f, 0x73,
+	0x65, 0x74, 0x5f, 0x62, 0x6f, 0x75, 0x6e, 0x64, 0x73, 0x00, 0x00, 0x03,
+	0x03, 0x02, 0x01, 0x02, 0x05, 0x03, 0x01, 0x00, 0x01, 0x07, 0x23, 0x03,
+	0x08, 0x6d, 0x6e, 0x69, 0x5f, 0x6e, 0x61, 0x6d, 0x65, 0x00, 0x01, 0x0b,
+	0x6d, 0x6e, 0x69, 0x5f, 0x70, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 0x00,
+	0x02, 0x06, 0x6d, 0x65, 0x6d, 0x6f, 0x72, 0x79, 0x02, 0x00, 0x0a, 0x12,
+	0x02, 0x04, 0x00, 0x41, 0x10, 0x0b, 0x0b, 0x00, 0x01, 0x41, 0xac, 0x02,
+	0x41, 0xc8, 0x01, 0x10, 0x00, 0x0b, 0x0b, 0x1b, 0x02, 0x00, 0x41, 0x00,
+	0x0b, 0x04, 0x61, 0x62, 0x63, 0x64, 0x00, 0x41, 0x10, 0x0b, 0x0c, 0x48,
+	0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x43, 0x6f, 0x64, 0x65, 0x73, 0x00,
+	// clang-format on
+};
+
+// Test reading metadata without decoding
+TEST(Wasm, Metadata) {
+	std::vector<uint8_t> data = METADATA_MODULE;
+
+	std::vector<uint8_t> optimized_bytes;
+	Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes, { .metadata = true });
+
+	Mni::Wasm::Metadata metadata;
+	EXPECT_TRUE(Mni::Wasm::ReadMetadata(optimized_bytes, 0, metadata));
+	EXPECT_EQ(metadata.name, "Hello Codes");
+	EXPECT_EQ(metadata.width, 300);
+	EXPECT_EQ(metadata.height, 200);
+	EXPECT_EQ(metadata.imports, std::vector<std::string> { "mni_set_bounds" });
+	EXPECT_EQ(metadata.exports, (std::vector<std::string> { "mni_prepare", "mni_name" }));
+
+	// Same names straight from the sections, in export order
+	std::vector<std::string> exports, imports;
+	EXPECT_TRUE(Mni::Wasm::ScanExports(data, exports, &imports));
+	EXPECT_EQ(exports, (std::vector<std::string> { "mni_name", "mni_prepare" }));
+	EXPECT_EQ(imports, std::vector<std::string> { "mni_set_bounds" });
+
+	// Cut inside the export section
+	std::vector<uint8_t> truncated(data.begin(), data.begin() + 70);
+	EXPECT_FALSE(Mni::Wasm::ScanExports(truncated, exports));
+
+	std::vector<uint8_t> new_data;
+	Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes);
+	EXPECT_EQ(data, new_data);
+
+	// Streams without a metadata block
+	optimized_bytes.clear();
+	Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+	EXPECT_TRUE(!Mni::Wasm::ReadMetadata(optimized_bytes, 0, metadata));
+
+	// Blocks exporting a runtime function id this build doesn't know
+	Mni::Wasm::Huffman huffman;
+	std::vector<uint8_t> unknown_export;
+	Mni::Wasm::OptimizedIO writer(unknown_export, 0, huffman);
+	writer.WriteUNum(1, 1);
+	// Name, width, height and imports
+	for(int i = 0; i < 4; i++) {
+		writer.WriteULEB(0);
+	}
+	writer.WriteULEB(1ULL << 63);
+	// Other exports and features
+	writer.WriteULEB(0);
+	writer.WriteULEB(0);
+	writer.PrependHeader();
+	EXPECT_FALSE(Mni::Wasm::ReadMetadata(unknown_export, 0, metadata));
+}
+
+// Test that compile time tables decode their own codes
+TEST(Wasm, BuiltinTables) {
+	auto& table  = Mni::Wasm::INSTRUCTION_TABLE;
+	auto rep_map = table.RepMap();
+
+	std::vector<uint8_t> bytes;
+	uint64_t current_bit = 0;
+	for(int value = 0; value < 256; value++) {
+		auto& rep   = rep_map.at(value);
+		current_bit = Mni::Encoding::WriteNumUnsigned(
+			rep.representation, rep.bit_size, current_bit, bytes);
+	}
+
+	uint64_t read_bit = 0;
+	for(int value = 0; value < 256; value++) {
+		uint8_t out;
+		read_bit = Mni::Decoding::ReadHuffmanValue<uint8_t>(table.nodes, &out, read_bit, bytes);
+		EXPECT_EQ(value, out);
+	}
+	EXPECT_EQ(current_bit, read_bit);
+}
+
+// Test that every runtime function name is found by its id
+TEST(Wasm, DefinedFunctions) {
+	auto& functions = Mni::Wasm::DEFINED_FUNCTIONS;
+	for(uint32_t id = 0; id < functions.names.size(); id++) {
+		EXPECT_EQ(functions.Find(functions.Name(id)), (int32_t)id);
+	}
+	EXPECT_EQ(functions.Find(""), -1);
+	EXPECT_EQ(functions.Find("mni_"), -1);
+	EXPECT_EQ(functions.Find("mni_zzz"), -1);
+	EXPECT_FALSE(functions.Contains(functions.names.size()));
+}
+
+// Test that known signatures and explicitly written function types decode to the same types
+TEST(Wasm, KnownSignatures) {
+	std::vector<uint8_t> types;
+	for(auto& signature : Mni::Wasm::KNOWN_SIGNATURES) {
+		types.push_back(0x60);
+		types.push_back(signature.num_params);
+		for(uint8_t j = 0; j < signature.num_params; j++) {
+			types.push_back(signature.params[j] & 0x7F);
+		}
+		types.push_back(signature.num_results);
+		if(signature.num_results) {
+			types.push_back(signature.result & 0x7F);
+		}
+	}
+	// (func (param i64)) and (func (param f64 f64) (result i64 i32)) have no known signature
+	types.insert(types.end(), { 0x60, 0x01, 0x7e, 0x00 });
+	types.insert(types.end(), { 0x60, 0x02, 0x7c, 0x7c, 0x02, 0x7e, 0x7f });
+	uint8_t num_types = std::size(Mni::Wasm::KNOWN_SIGNATURES) + 2;
+
+	std::vector<uint8_t> data = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01 };
+	ASSERT_TRUE(types.size() + 1 < 0x80);
+	data.push_back(types.size() + 1);
+	data.push_back(num_types);
+	data.insert(data.end(), types.begin(), types.end());
+
+	std::vector<Mni::Wasm::TracedItem> trace;
+	std::vector<uint8_t> optimized_bytes;
+	uint64_t size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes, { .trace = &trace });
+	std::vector<uint8_t> new_data;
+	EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes), size);
+	EXPECT_EQ(data, new_data);
+
+	// Known signatures take the flag and their id, the rest is written item by item
+	std::vector<uint8_t> type_bits;
+	for(auto& item : trace) {
+		if(item.type == Mni::Wasm::TYPE && item.section == 1) {
+			type_bits.push_back(item.bits);
+		}
+	}
+	ASSERT_TRUE(type_bits.size() > std::size(Mni::Wasm::KNOWN_SIGNATURES));
+	for(size_t i = 0; i < std::size(Mni::Wasm::KNOWN_SIGNATURES); i++) {
+		EXPECT_EQ(type_bits[i], 1 + Mni::Wasm::SIGNATURE_BITS);
+	}
+}
+
+// Test nested control, unaligned memory ops and exception handling roundtrip
+TEST(Wasm, ControlFlow) {
+	std::vector<uint8_t> body = {
+		// clang-format off
+		0x00,                               // No locals
+		0x02, 0x40,                         // block
+		0x03, 0x40,                         //   loop
+		0x41, 0x00, 0x28, 0x00, 0x03,       //     i32.load align=1 offset=3
+		0x04, 0x40,                         //     if
+		0x02, 0x40, 0x0c, 0x02, 0x0b,       //       block br 2 end
+		0x05,                               //     else
+		0x41, 0x00, 0x42, 0x00, 0x37, 0x00, //       i64.store align=1
+		0x00,
+		0x0b,                               //     end
+		0x41, 0x00, 0x2f, 0x00, 0x00, 0x1a, //     i32.load16_u align=1, drop
+		0x0b,                               //   end
+		0x0b,                               // end
+		0x06, 0x40,                         // try
+		0x06, 0x40,                         //   try
+		0x08, 0x00,                         //     throw 0
+		0x18, 0x00,                         //   delegate 0
+		0x07, 0x00,                         // catch 0
+		0x02, 0x40, 0x0b,                   //   block end
+		0x19,                               // catch_all
+		0x09, 0x00,                         //   rethrow 0
+		0x0b,                               // end
+		0x1f, 0x40, 0x02, 0x00, 0x00, 0x00, // try_table (catch 0 0) (catch_all 0)
+		0x02, 0x00, 0x0b,                   // end
+		0x0b,
+		// clang-format on
+	};
+	// (type (func)) (func (type 0)) (memory 1) (tag (type 0))
+	std::vector<uint8_t> data = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x04,
+		0x01, 0x60, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0x05, 0x03, 0x01, 0x00, 0x01, 0x0d, 0x03,
+		0x01, 0x00, 0x00 };
+	ASSERT_TRUE(body.size() + 2 < 0x80);
+	data.insert(data.end(), { 0x0a, (uint8_t)(body.size() + 2), 0x01, (uint8_t)body.size() });
+	data.insert(data.end(), body.begin(), body.end());
+
+	for(int i = 0; i < 3; i++) {
+		std::vector<uint8_t> optimized_bytes;
+		uint64_t size = Mni::Wasm::NormalToOptimized(
+			data, 0, optimized_bytes, { .columns = i == 1, .function_index = i == 2 });
+		std::vector<uint8_t> new_data;
+		EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes), size);
+		EXPECT_EQ(data, new_data);
+
+		if(i == 2) {
+			std::vector<uint8_t> decoded;
+			EXPECT_TRUE(Mni::Wasm::DecodeFunction(optimized_bytes, 0, 0, decoded));
+			EXPECT_EQ(decoded, CodeBodies(data)[0]);
+		}
+	}
+}
+
+// Test that damaged streams are rejected instead of read past their end
+TEST(Wasm, DamagedStreams) {
+	std::mt19937 rng(5);
+	ForEachModule(5, 100, [&](std::vector<uint8_t>& data, int) {
+		std::vector<uint8_t> optimized_bytes;
+		Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes, { .function_index = true });
+
+		// Truncated streams never decode
+		std::vector<uint8_t> truncated(
+			optimized_bytes.begin(), optimized_bytes.begin() + optimized_bytes.size() / 2);
+		std::vector<uint8_t> new_data;
+		EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, truncated), 0);
+		EXPECT_TRUE(new_data.empty());
+
+		// Flipped bits with a matching checksum reach the decoder, which only has to return
+		std::vector<uint8_t> flipped = optimized_bytes;
+		for(int j = 0; j < 8; j++) {
+			flipped[rng() % flipped.size()] ^= 1 << (rng() % 8);
+		}
+		Mni::Wasm::SealPayload(flipped, 0);
+		Mni::Wasm::OptimizedToNormal(new_data, 0, flipped);
+		std::vector<uint8_t> body;
+		Mni::Wasm::DecodeFunction(flipped, 0, 0, body);
+
+		// A known signature id past the table is rejected
+		std::vector<Mni::Wasm::TracedItem> trace;
+		EXPECT_TRUE(Mni::Wasm::TraceItems(optimized_bytes, true, trace));
+		auto type = std::find_if(trace.begin(), trace.end(), [](auto& item) {
+			return item.type == Mni::Wasm::TYPE && item.section == 1;
+		});
+		if(type != trace.end()
+			&& (optimized_bytes[type->bit / 8] & (0x80 >> (type->bit % 8)))) {
+			std::vector<uint8_t> bad_signature = optimized_bytes;
+			for(uint64_t bit = type->bit + 1; bit <= type->bit + Mni::Wasm::SIGNATURE_BITS;
+				bit++) {
+				bad_signature[bit / 8] |= 0x80 >> (bit % 8);
+			}
+			EXPECT_TRUE(Mni::Wasm::SealPayload(bad_signature, 0));
+			EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, bad_signature), 0);
+		}
+	});
+
+	// Matches reaching before the data or past its length
+	for(uint64_t zero_run : { 0, 1 }) {
+		Mni::Wasm::Huffman huffman;
+		std::vector<uint8_t> bytes;
+		Mni::Wasm::OptimizedIO writer(bytes, 0, huffman);
+		// Compressed
+		writer.WriteUNum(1, 1);
+		if(zero_run) {
+			writer.WriteUNum(0b10, 2);
+			writer.WriteULEB(0);
+		}
+		writer.WriteUNum(0b11, 2);
+		writer.WriteULEB(0);
+		writer.WriteULEB(0);
+
+		Mni::Wasm::OptimizedIO reader(bytes, 0, huffman);
+		reader.SetReadLimits(bytes.size() * 8);
+		auto data = reader.ReadData(Mni::Lz::MIN_ZERO_RUN + 1);
+		EXPECT_TRUE(reader.Failed());
+		EXPECT_TRUE(data.empty());
+	}
+}
+
+// Test that the payload header rejects corrupt streams and ignores padding
+TEST(Wasm, PayloadHeader) {
+	std::mt19937 rng(6);
+	ForEachModule(6, 100, [&](std::vector<uint8_t>& data, int) {
+		std::vector<uint8_t> optimized_bytes;
+		uint64_t size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+		EXPECT_EQ((size + 7) / 8, optimized_bytes.size());
+		EXPECT_TRUE(Mni::Wasm::CheckPayload(optimized_bytes, 0));
+
+		// Padding after the exact length, like a QR code adds
+		std::vector<uint8_t> padded = optimized_bytes;
+		padded.insert(padded.end(), 16, 0xEC);
+		std::vector<uint8_t> new_data;
+		EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, padded), size);
+		EXPECT_EQ(data, new_data);
+
+		// Any single flipped bit is caught by the version or checksum
+		std::vector<uint8_t> flipped = optimized_bytes;
+		uint64_t bit                 = rng() % size;
+		flipped[bit / 8] ^= 0x80 >> (bit % 8);
+		EXPECT_FALSE(Mni::Wasm::CheckPayload(flipped, 0));
+		EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, flipped), 0);
+	});
+}
+
+// Test that streams using a dictionary newer than this build are rejected
+TEST(Wasm, UnknownDictionary) {
+	// Empty module, so nothing but the version decides whether it decodes
+	std::vector<uint8_t> data = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+	std::vector<uint8_t> optimized_bytes;
+	uint64_t size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+	std::vector<uint8_t> new_data;
+	EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes), size);
+
+	// The version follows the metadata bit
+	Mni::Wasm::Huffman huffman;
+	Mni::Wasm::OptimizedIO header_io(optimized_bytes, 0, huffman);
+	header_io.SetReadLimits(optimized_bytes.size() * 8);
+	EXPECT_TRUE(header_io.ReadHeader());
+	EXPECT_EQ(header_io.ReadUNum(1), 0);
+	Mni::Encoding::WriteNumUnsigned((1 << Mni::Wasm::DICTIONARY_VERSION_BITS) - 1,
+		Mni::Wasm::DICTIONARY_VERSION_BITS, header_io.GetCurrentBit(), optimized_bytes);
+	EXPECT_TRUE(Mni::Wasm::SealPayload(optimized_bytes, 0));
+	EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes), 0);
+}
+
+// Test that the bytes of active segments are moved out of the decoded module
+TEST(Wasm, ActiveSegments) {
+	std::vector<uint8_t> data = METADATA_MODULE;
+
+	std::vector<uint8_t> optimized_bytes;
+	uint64_t size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+
+	std::vector<uint8_t> new_data;
+	std::vector<Mni::Wasm::ActiveSegment> segments;
+	EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes, segments), size);
+
+	// Both segments are kept, but empty
+	std::vector<uint8_t> expected(data.begin(), data.end() - 29);
+	expected.insert(expected.end(),
+		{ 0x0b, 0x0b, 0x02, 0x00, 0x41, 0x00, 0x0b, 0x00, 0x00, 0x41, 0x10, 0x0b, 0x00 });
+	EXPECT_EQ(new_data, expected);
+
+	ASSERT_EQ(segments.size(), 2);
+	EXPECT_EQ(segments[0].offset, 0);
+	EXPECT_EQ(segments[0].bytes, (std::vector<uint8_t> { 'a', 'b', 'c', 'd' }));
+	EXPECT_EQ(segments[1].offset, 16);
+	EXPECT_EQ(std::string(segments[1].bytes.begin(), segments[1].bytes.end()),
+		std::string("Hello Codes\0", 12));
+
+	// (memory 1) (data (i32.const 0) "abcd") without a memory export keeps its data
+	data = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x05, 0x03, 0x01, 0x00, 0x01, 0x0b,
+		0x0a, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x04, 0x61, 0x62, 0x63, 0x64 };
+	optimized_bytes.clear();
+	size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+	EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes, segments), size);
+	EXPECT_EQ(new_data, data);
+	EXPECT_TRUE(segments.empty());
+
+	// (memory (export "memory") 1) (global i32 (i32.const 0))
+	// (data (i32.const 0) "ab") (data (global.get 0) "cd") keeps its data, as copying the first
+	// segment in after instantiation would overwrite the second
+	data = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x05, 0x03, 0x01, 0x00, 0x01, 0x06,
+		0x06, 0x01, 0x7f, 0x00, 0x41, 0x00, 0x0b, 0x07, 0x0a, 0x01, 0x06, 0x6d, 0x65, 0x6d, 0x6f,
+		0x72, 0x79, 0x02, 0x00, 0x0b, 0x0f, 0x02, 0x00, 0x41, 0x00, 0x0b, 0x02, 0x61, 0x62, 0x00,
+		0x23, 0x00, 0x0b, 0x02, 0x63, 0x64 };
+	optimized_bytes.clear();
+	size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes);
+	EXPECT_EQ(Mni::Wasm::OptimizedToNormal(new_data, 0, optimized_bytes, segments), size);
+	EXPECT_EQ(new_data, data);
+	EXPECT_TRUE(segments.empty());
+}
+
+// Test that normal and optimized streams list the same instructions
+TEST(Wasm, Disassemble) {
+	ForEachModule(7, 100, [](std::vector<uint8_t>& data, int i) {
+		std::vector<uint8_t> optimized_bytes;
+		Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes, { .columns = i % 2 == 1 });
+
+		Mni::Parser normal(data.data(), data.size());
+		Mni::Parser optimized(optimized_bytes.data(), optimized_bytes.size());
+		EXPECT_TRUE(normal.IsValid());
+		EXPECT_TRUE(optimized.IsValid());
+		EXPECT_FALSE(normal.IsOptimized());
+		EXPECT_TRUE(optimized.IsOptimized());
+
+		auto Instructions = [](Mni::Parser& parser) {
+			std::vector<std::string_view> names;
+			uint64_t bits = 0;
+			for(auto item : parser) {
+				if(item.type == Mni::Wasm::INSTRUCTION) {
+					names.push_back(item.name);
+				}
+				bits += item.bits;
+			}
+			EXPECT_LE(bits, parser.GetSize());
+			return names;
+		};
+		EXPECT_EQ(Instructions(normal), Instructions(optimized));
+	});
+}
+
+// Test that the bits attributed while encoding match the items read back
+TEST(Wasm, BitStats) {
+	ForEachModule(8, 100, [](std::vector<uint8_t>& data, int i) {
+		std::vector<Mni::Wasm::TracedItem> trace;
+		std::vector<uint8_t> optimized_bytes;
+		uint64_t size = Mni::Wasm::NormalToOptimized(data, 0, optimized_bytes,
+			{ .columns = i % 2 == 1, .function_index = i % 2 == 0, .trace = &trace });
+
+		std::vector<Mni::Wasm::TracedItem> read_trace;
+		EXPECT_TRUE(Mni::Wasm::TraceItems(optimized_bytes, true, read_trace));
+		ASSERT_EQ(trace.size(), read_trace.size());
+		for(size_t j = 0; j < trace.size(); j++) {
+			EXPECT_EQ(trace[j].type, read_trace[j].type);
+			EXPECT_EQ(trace[j].bits, read_trace[j].bits);
+			EXPECT_EQ(trace[j].section, read_trace[j].section);
+			EXPECT_EQ(trace[j].function, read_trace[j].function);
 		}
+
+		// Every bit belongs to the header or exactly one item
+		auto stats         = Mni::Wasm::CountBits(trace, size);
+		uint64_t type_bits = 0;
+		for(auto bits : stats.type_bits) {
+			type_bits += bits;
+		}
+		EXPECT_EQ(stats.header_bits + type_bits, size);
+	});
+}
+
+// Test that the shrink loop keeps to its round and time limits
+TEST(Wasm, ShrinkRounds) {
+	// (func (export "mni_prepare") (result i32) (i32.add (i32.const 1) (i32.const 2)))
+	std::vector<uint8_t> data = {
+		// clang-format off
+		0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05, 0x01, 0x60,
+		0x00, 0x01, 0x7f, 0x03, 0x02, 0x01, 0x00, 0x07, 0x0f, 0x01, 0x0b, 0x6d,
+		0x6e, 0x69, 0x5f, 0x70, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 0x00, 0x00,
+		0x0a, 0x09, 0x01, 0x07, 0x00, 0x41, 0x01, 0x41, 0x02, 0x6a, 0x0b,
+		// clang-format on
+	};
+
+	// The first round runs every function
+	std::vector<uint8_t> out;
+	std::vector<std::string> exports;
+	std::vector<Mni::Wasm::ShrinkRound> rounds;
+	Mni::Wasm::RemoveUnneccesary(data, out, Mni::Wasm::DEFINED_FUNCTIONS.names, &exports,
+		{ .max_rounds = 1, .rounds = &rounds });
+	ASSERT_EQ(rounds.size(), 1);
+	EXPECT_EQ(rounds[0].functions, 1);
+	EXPECT_EQ(exports, std::vector<std::string> { "mni_prepare" });
+
+	// Without limits every round but the last shrinks the module
+	rounds.clear();
+	Mni::Wasm::RemoveUnneccesary(
+		data, out, Mni::Wasm::DEFINED_FUNCTIONS.names, nullptr, { .rounds = &rounds });
+	ASSERT_TRUE(!rounds.empty());
+	for(size_t i = 1; i + 1 < rounds.size(); i++) {
+		EXPECT_LT(rounds[i].estimate, rounds[i - 1].estimate);
+	}
+
+	// Rounds after the first only start if the last one would fit again
+	rounds.clear();
+	std::chrono::milliseconds budget { 1 };
+	Mni::Wasm::RemoveUnneccesary(data, out, Mni::Wasm::DEFINED_FUNCTIONS.names, nullptr,
+		{ .time_budget = budget, .rounds = &rounds });
+	ASSERT_TRUE(!rounds.empty());
+	std::chrono::microseconds started { 0 };
+	for(size_t i = 0; i + 1 < rounds.size(); i++) {
+		started += rounds[i].time;
+	}
+	EXPECT_LE(started.count(), std::chrono::microseconds(budget).count());
+
+	// Any pipeline fits version 40, so only the first one scored runs
+	std::vector<Mni::Wasm::SearchResult> searched;
+	Mni::Wasm::RemoveUnneccesary(data, out, Mni::Wasm::DEFINED_FUNCTIONS.names, nullptr,
+		{ .search = true, .target_version = 40, .searched = &searched });
+	ASSERT_TRUE(!searched.empty());
+	size_t scored = 0;
+	for(auto& result : searched) {
+		scored += result.bits != UINT64_MAX;
 	}
+	EXPECT_EQ(scored, 1);
 }
 
 // Test running an example binary, requires user input